@@ -0,0 +1,649 @@
+// 부하/지연 측정 도구
+// server를 루프백 포트에 띄우고 가상 클라이언트 N명을 붙여 입장, 채팅, !quiz,
+// 정답 시도, !rank를 섞어 보낸다. 연결 속도, 메시지 처리량, 방 브로드캐스트
+// 지연(보낸 쪽이 채팅에 넣은 시각과 받은 쪽 시각의 차)의 p50/p99/p999를
+// 한 줄짜리 JSON으로 출력한다. --baseline으로 이전 결과와 비교할 수 있다.
+//
+// 사용법: bench [--server ./server] [--port 18888] [--clients 200] [--rooms 4]
+//               [--rate 10] [--duration 5] [--shards 1] [--backend epoll|uring] [--attach]
+//               [--out 파일] [--baseline 파일] [--tolerance 10]
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "protocol.h"
+
+#define DEFAULT_PORT 18888
+#define DEFAULT_CLIENTS 200
+#define DEFAULT_ROOMS 4
+#define DEFAULT_RATE 10         // 클라이언트 한 명이 초당 보내는 메시지 수
+#define DEFAULT_DURATION 5      // 채팅, 퀴즈 단계 각각의 길이(초)
+#define DEFAULT_TOLERANCE 10    // --baseline 비교 때 허용하는 악화 비율(%)
+#define MAX_CLIENTS 20000
+#define MAX_EVENTS 256
+#define OUT_SIZE 8192           // 클라이언트별 송신 버퍼
+#define LINE_SIZE 256
+#define SETTLE_MS 500           // 모두 방에 들어간 뒤 측정 전까지 기다리는 시간
+#define CONNECT_TIMEOUT_MS 10000
+#define RANK_PERCENT 2          // 보내는 메시지 중 !rank 비율
+#define CORRECT_PERCENT 5       // 퀴즈 단계에서 정답을 보내는 비율
+#define HIST_SUB 32             // 히스토그램: 2배 구간 하나를 32칸으로 (오차 약 3%)
+#define HIST_SIZE (64 * HIST_SUB)
+
+enum phase {
+    PH_CONNECT,     // 접속, 닉네임, 방 이동
+    PH_SETTLE,
+    PH_CHAT,        // 시각을 넣은 채팅 + !rank
+    PH_QUIZ,        // 방마다 출제자 한 명, 나머지는 정답 시도
+    PH_DONE,
+};
+
+// 가상 클라이언트 하나
+struct bclient {
+    int fd;
+    int id;
+    int room;
+    char nick[16];
+    int enters;             // 자기 입장 알림을 받은 횟수 (로비, 측정 방)
+    int synced;             // FR_HELLO를 받음
+    char* in;
+    size_t in_len;
+    size_t in_cap;
+    char out[OUT_SIZE];
+    size_t out_len;
+    long long next_send;    // 다음 메시지를 보낼 시각(ns)
+};
+
+// 측정 방 하나. 출제자(leader)만 !quiz를 보낸다.
+struct broom {
+    int leader;
+    int pending;            // !quiz를 보냈고 출제 알림을 기다리는 중
+    int active;
+    char answer[LINE_SIZE];
+    long long quiz_sent;    // !quiz를 보낸 시각(ns)
+};
+
+// 로그 구간 히스토그램 (값 단위: us)
+struct histogram {
+    unsigned long long count[HIST_SIZE];
+    unsigned long long total;
+    unsigned long long sum;
+    unsigned long long max;
+};
+
+struct stats {
+    int connect_ok;
+    int connect_failed;
+    long long connect_start;
+    long long connect_end;
+    unsigned long long chat_sent;
+    unsigned long long chat_delivered;
+    unsigned long long dropped;         // 송신 버퍼가 차서 못 보낸 메시지
+    unsigned long long rank_requests;
+    unsigned long long quiz_rounds;
+    unsigned long long quiz_timeouts;
+    unsigned long long quiz_guesses;
+    unsigned long long frames;
+    unsigned long long bytes;
+    struct histogram chat_lat;
+    struct histogram quiz_lat;
+};
+
+const char* server_path = "./server";
+int port = DEFAULT_PORT;
+int num_clients = DEFAULT_CLIENTS;
+int num_rooms = DEFAULT_ROOMS;
+int rate = DEFAULT_RATE;
+int duration = DEFAULT_DURATION;
+int shards = 1;
+const char* backend = "epoll";
+int attach = 0;
+const char* out_path = NULL;
+const char* baseline_path = NULL;
+int tolerance = DEFAULT_TOLERANCE;
+
+struct bclient* clients;
+struct broom* rooms;
+struct stats st;
+enum phase phase = PH_CONNECT;
+int epfd;
+unsigned quiz_word_seq = 0;
+pid_t server_pid = -1;
+
+long long now_ns(void);
+void hist_add(struct histogram* h, unsigned long long v);
+unsigned long long hist_percentile(const struct histogram* h, double p);
+pid_t spawn_server(void);
+int wait_for_port(int timeout_ms);
+void client_open(struct bclient* c);
+void client_close(struct bclient* c);
+void client_send(struct bclient* c, const char* line);
+int client_flush(struct bclient* c);
+void client_read(struct bclient* c);
+void on_frame(struct bclient* c, uint8_t type, char* body, uint32_t len);
+void client_tick(struct bclient* c, long long now);
+void run_loop(long long until, enum phase stop_when);
+void report(FILE* fp);
+int compare_baseline(const char* path);
+
+long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 값 v의 칸: 32 미만은 그대로, 그 위는 2배 구간마다 HIST_SUB칸
+static int hist_index(unsigned long long v) {
+    if (v < HIST_SUB) return v;
+    int e = 63 - __builtin_clzll(v) - 5;
+    int idx = e * HIST_SUB + (int)(v >> e);
+    return idx < HIST_SIZE ? idx : HIST_SIZE - 1;
+}
+
+// 칸 idx에 들어가는 가장 작은 값
+static unsigned long long hist_value(int idx) {
+    if (idx < 2 * HIST_SUB) return idx;
+    int e = idx / HIST_SUB - 1;
+    return (unsigned long long)(idx % HIST_SUB + HIST_SUB) << e;
+}
+
+void hist_add(struct histogram* h, unsigned long long v) {
+    h->count[hist_index(v)]++;
+    h->total++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
+}
+
+unsigned long long hist_percentile(const struct histogram* h, double p) {
+    if (h->total == 0) return 0;
+    unsigned long long want = (unsigned long long)(h->total * p);
+    if (want >= h->total) want = h->total - 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < HIST_SIZE; i++) {
+        seen += h->count[i];
+        if (seen > want) return hist_value(i);
+    }
+    return h->max;
+}
+
+// server를 띄운다. 출력은 버린다.
+pid_t spawn_server(void) {
+    char port_s[16], max_s[16], shards_s[16];
+    snprintf(port_s, sizeof(port_s), "%d", port);
+    snprintf(max_s, sizeof(max_s), "%d", num_clients + 16);
+    snprintf(shards_s, sizeof(shards_s), "%d", shards);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null != -1) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            close(null);
+        }
+        execl(server_path, server_path, "-p", port_s, "-m", max_s, "-t", shards_s,
+            "-b", backend, "-H", "-", "-S", "-", "-i", "0", (char*)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+// 포트에 접속되면 0
+int wait_for_port(int timeout_ms) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    for (int waited = 0; waited < timeout_ms; waited += 50) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int ok = fd != -1 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (fd != -1) close(fd);
+        if (ok) return 0;
+        if (server_pid > 0 && waitpid(server_pid, NULL, WNOHANG) == server_pid) {
+            server_pid = -1;
+            return -1;
+        }
+        usleep(50 * 1000);
+    }
+    return -1;
+}
+
+void client_open(struct bclient* c) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd == -1 || (connect(c->fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 && errno != EINPROGRESS)) {
+        client_close(c);
+        st.connect_failed++;
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+
+    // 협상, 닉네임, 측정 방 이동을 한 번에 보낸다. 서버는 차례대로 처리한다.
+    char line[LINE_SIZE];
+    memcpy(c->out, PROTO_HELLO "\n", strlen(PROTO_HELLO "\n"));
+    c->out_len = strlen(PROTO_HELLO "\n");
+    client_send(c, c->nick);
+    snprintf(line, sizeof(line), "!join bench%d", c->room);
+    client_send(c, line);
+}
+
+void client_close(struct bclient* c) {
+    if (c->fd != -1) close(c->fd);
+    c->fd = -1;
+}
+
+// 한 줄을 FR_LINE 프레임으로 송신 버퍼에 넣고 보내 본다.
+void client_send(struct bclient* c, const char* line) {
+    uint8_t hdr[FRAME_HDR_MAX];
+    size_t len = strlen(line);
+    int hdr_len = frame_header(hdr, FR_LINE, len);
+    if (c->fd == -1) return;
+    if (c->out_len + hdr_len + len > sizeof(c->out)) {
+        st.dropped++;
+        return;
+    }
+    memcpy(c->out + c->out_len, hdr, hdr_len);
+    memcpy(c->out + c->out_len + hdr_len, line, len);
+    c->out_len += hdr_len + len;
+    if (client_flush(c) == -1) client_close(c);
+}
+
+int client_flush(struct bclient* c) {
+    size_t off = 0;
+    while (off < c->out_len) {
+        ssize_t n = write(c->fd, c->out + off, c->out_len - off);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN) break;
+            return -1;
+        }
+        off += n;
+    }
+    memmove(c->out, c->out + off, c->out_len - off);
+    c->out_len -= off;
+    return 0;
+}
+
+void client_read(struct bclient* c) {
+    while (c->fd != -1) {
+        if (c->in_cap - c->in_len < 4096) {
+            size_t cap = c->in_cap ? c->in_cap * 2 : 16384;
+            char* bigger = realloc(c->in, cap);
+            if (bigger == NULL) {
+                client_close(c);
+                return;
+            }
+            c->in = bigger;
+            c->in_cap = cap;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len - 1);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            client_close(c);
+            return;
+        }
+        st.bytes += n;
+        c->in_len += n;
+
+        size_t pos = 0;
+        if (!c->synced) {
+            char* zero = memchr(c->in, 0, c->in_len);
+            if (zero == NULL) {
+                c->in_len = 0;
+                continue;
+            }
+            pos = zero - c->in;
+            c->synced = 1;
+        }
+        while (pos < c->in_len) {
+            uint8_t type;
+            uint32_t len;
+            int h = frame_parse((uint8_t*)c->in + pos, c->in_len - pos, &type, &len);
+            if (h < 0) {
+                client_close(c);
+                return;
+            }
+            if (h == 0 || c->in_len - pos - h < len) break;
+            char* body = c->in + pos + h;
+            char saved = body[len];
+            body[len] = '\0';
+            on_frame(c, type, body, len);
+            body[len] = saved;
+            pos += h + len;
+        }
+        memmove(c->in, c->in + pos, c->in_len - pos);
+        c->in_len -= pos;
+    }
+}
+
+// 받은 프레임 하나를 처리한다.
+void on_frame(struct bclient* c, uint8_t type, char* body, uint32_t len) {
+    long long now = now_ns();
+    struct broom* r = &rooms[c->room];
+    (void)len;
+    st.frames++;
+
+    switch (type) {
+    case FR_ENTER: {
+        // "👤 <닉네임> 님이 입장하였습니다."
+        const char* p = strstr(body, c->nick);
+        size_t nl = strlen(c->nick);
+        if (p && p[nl] == ' ' && (p == body || p[-1] == ' ')) {
+            c->enters++;
+            if (c->enters == 1) {
+                st.connect_ok++;
+                st.connect_end = now;
+            }
+        }
+        break;
+    }
+    case FR_CHAT: {
+        // "<닉네임>: T<보낸 시각 ns>"
+        const char* p = strstr(body, ": T");
+        if (p && phase == PH_CHAT) {
+            long long sent = strtoll(p + 3, NULL, 10);
+            if (sent > 0 && sent <= now) {
+                st.chat_delivered++;
+                hist_add(&st.chat_lat, (now - sent) / 1000);
+            }
+        }
+        break;
+    }
+    case FR_QUIZ:
+        if (c->id == r->leader) {
+            r->pending = 0;
+            r->active = 1;
+        }
+        break;
+    case FR_CORRECT:
+    case FR_TIMEOUT:
+        if (c->id == r->leader && r->active) {
+            r->active = 0;
+            if (type == FR_CORRECT) {
+                st.quiz_rounds++;
+                hist_add(&st.quiz_lat, (now - r->quiz_sent) / 1000);
+            }
+            else {
+                st.quiz_timeouts++;
+            }
+        }
+        break;
+    case FR_ERROR:
+        // 다른 사람이 먼저 낸 퀴즈와 겹치면 다음 틱에 다시 낸다.
+        if (c->id == r->leader && r->pending) r->pending = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+// 보낼 시각이 된 클라이언트가 단계에 맞는 메시지를 하나 보낸다.
+void client_tick(struct bclient* c, long long now) {
+    struct broom* r = &rooms[c->room];
+    char line[LINE_SIZE];
+    if (c->fd == -1 || c->enters < 2 || now < c->next_send) return;
+    c->next_send += 1000000000LL / rate;
+    if (c->next_send < now) c->next_send = now;
+
+    if (rand() % 100 < RANK_PERCENT) {
+        client_send(c, "!rank");
+        st.rank_requests++;
+        return;
+    }
+    if (phase == PH_CHAT) {
+        snprintf(line, sizeof(line), "T%lld", now);
+        client_send(c, line);
+        st.chat_sent++;
+    }
+    else if (phase == PH_QUIZ && c->id == r->leader) {
+        if (r->active || r->pending) return;
+        // 한 번 낸 단어는 다시 낼 수 없으므로 번호를 영문자로 바꿔 붙인다.
+        int n = snprintf(line, sizeof(line), "!quiz bq");
+        for (unsigned v = quiz_word_seq++; ; v /= 26) {
+            line[n++] = 'a' + v % 26;
+            if (v < 26) break;
+        }
+        line[n] = '\0';
+        snprintf(r->answer, sizeof(r->answer), "%s", line + 6);
+        r->pending = 1;
+        r->quiz_sent = now;
+        client_send(c, line);
+    }
+    else if (phase == PH_QUIZ && r->active) {
+        if (rand() % 100 < CORRECT_PERCENT) client_send(c, r->answer);
+        else client_send(c, "wrong");
+        st.quiz_guesses++;
+    }
+}
+
+// until(ns)까지, 또는 stop_when 단계의 조건을 채울 때까지 이벤트를 처리한다.
+void run_loop(long long until, enum phase stop_when) {
+    struct epoll_event events[MAX_EVENTS];
+    long long next_tick = 0;
+
+    while (1) {
+        long long now = now_ns();
+        if (now >= until) return;
+        if (stop_when == PH_CONNECT) {
+            int ready = 0;
+            for (int i = 0; i < num_clients; i++) {
+                if (clients[i].fd == -1 || clients[i].enters >= 2) ready++;
+            }
+            if (ready == num_clients) return;
+        }
+        if (now >= next_tick && (phase == PH_CHAT || phase == PH_QUIZ)) {
+            for (int i = 0; i < num_clients; i++) client_tick(&clients[i], now);
+            next_tick = now + 1000000;  // 1ms
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, 1);
+        for (int i = 0; i < n; i++) {
+            struct bclient* c = events[i].data.ptr;
+            if (events[i].events & EPOLLOUT && c->fd != -1 && client_flush(c) == -1) client_close(c);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) client_read(c);
+        }
+    }
+}
+
+// 결과를 한 줄짜리 JSON으로 쓴다. 키는 모두 최상위에 두어 비교하기 쉽게 한다.
+void report(FILE* fp) {
+    double connect_s = st.connect_ok ? (st.connect_end - st.connect_start) / 1e9 : 0;
+    double chat_mean = st.chat_lat.total ? (double)st.chat_lat.sum / st.chat_lat.total : 0;
+    fprintf(fp, "{\"server\":\"%s\",\"backend\":\"%s\",\"shards\":%d,\"clients\":%d,\"rooms\":%d,\"rate\":%d,\"duration_s\":%d,",
+        attach ? "attached" : server_path, backend, shards, num_clients, num_rooms, rate, duration);
+    fprintf(fp, "\"connect_ok\":%d,\"connect_failed\":%d,\"connect_seconds\":%.3f,\"connect_per_sec\":%.1f,",
+        st.connect_ok, st.connect_failed, connect_s, connect_s > 0 ? st.connect_ok / connect_s : 0);
+    fprintf(fp, "\"chat_sent\":%llu,\"chat_delivered\":%llu,\"chat_sent_per_sec\":%.1f,\"chat_delivered_per_sec\":%.1f,",
+        st.chat_sent, st.chat_delivered, (double)st.chat_sent / duration, (double)st.chat_delivered / duration);
+    fprintf(fp, "\"chat_p50_us\":%llu,\"chat_p99_us\":%llu,\"chat_p999_us\":%llu,\"chat_max_us\":%llu,\"chat_mean_us\":%.1f,",
+        hist_percentile(&st.chat_lat, 0.50), hist_percentile(&st.chat_lat, 0.99),
+        hist_percentile(&st.chat_lat, 0.999), st.chat_lat.max, chat_mean);
+    fprintf(fp, "\"quiz_rounds\":%llu,\"quiz_timeouts\":%llu,\"quiz_guesses\":%llu,\"quiz_round_p50_us\":%llu,\"quiz_round_p99_us\":%llu,",
+        st.quiz_rounds, st.quiz_timeouts, st.quiz_guesses,
+        hist_percentile(&st.quiz_lat, 0.50), hist_percentile(&st.quiz_lat, 0.99));
+    fprintf(fp, "\"rank_requests\":%llu,\"dropped\":%llu,\"frames_received\":%llu,\"bytes_received\":%llu}\n",
+        st.rank_requests, st.dropped, st.frames, st.bytes);
+}
+
+static int json_number(const char* text, const char* key, double* out) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char* p = strstr(text, pat);
+    if (p == NULL) return -1;
+    *out = strtod(p + strlen(pat), NULL);
+    return 0;
+}
+
+// 이전 결과와 비교해 tolerance%보다 나빠진 항목을 알린다. 나빠졌으면 1.
+int compare_baseline(const char* path) {
+    static const struct {
+        const char* key;
+        int higher_better;
+    } checks[] = {
+        { "connect_per_sec", 1 },
+        { "chat_delivered_per_sec", 1 },
+        { "chat_p50_us", 0 },
+        { "chat_p99_us", 0 },
+        { "chat_p999_us", 0 },
+    };
+    char old[8192], cur[8192];
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "기준 결과 '%s'를 열 수 없습니다. (%s)\n", path, strerror(errno));
+        return 1;
+    }
+    size_t n = fread(old, 1, sizeof(old) - 1, fp);
+    old[n] = '\0';
+    fclose(fp);
+
+    FILE* mem = fmemopen(cur, sizeof(cur), "w");
+    if (mem == NULL) return 1;
+    report(mem);
+    fclose(mem);
+
+    int worse = 0;
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        double a, b;
+        if (json_number(old, checks[i].key, &a) || json_number(cur, checks[i].key, &b) || a <= 0) continue;
+        double change = (b - a) / a * 100;
+        int bad = checks[i].higher_better ? change < -tolerance : change > tolerance;
+        fprintf(stderr, "%-24s %12.1f → %12.1f (%+.1f%%)%s\n", checks[i].key, a, b, change, bad ? "  ← 악화" : "");
+        worse |= bad;
+    }
+    return worse;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--attach")) {
+            attach = 1;
+            continue;
+        }
+        if (val == NULL) {
+            fprintf(stderr, "'%s'에 값이 필요합니다.\n", arg);
+            return 1;
+        }
+        i++;
+        if (!strcmp(arg, "--server")) server_path = val;
+        else if (!strcmp(arg, "--port")) port = atoi(val);
+        else if (!strcmp(arg, "--clients")) num_clients = atoi(val);
+        else if (!strcmp(arg, "--rooms")) num_rooms = atoi(val);
+        else if (!strcmp(arg, "--rate")) rate = atoi(val);
+        else if (!strcmp(arg, "--duration")) duration = atoi(val);
+        else if (!strcmp(arg, "--shards")) shards = atoi(val);
+        else if (!strcmp(arg, "--backend")) backend = val;
+        else if (!strcmp(arg, "--out")) out_path = val;
+        else if (!strcmp(arg, "--baseline")) baseline_path = val;
+        else if (!strcmp(arg, "--tolerance")) tolerance = atoi(val);
+        else {
+            fprintf(stderr, "알 수 없는 옵션: %s\n", arg);
+            return 1;
+        }
+    }
+    if (num_clients < 1 || num_clients > MAX_CLIENTS || num_rooms < 1 || num_rooms > num_clients
+        || rate < 1 || rate > 1000 || duration < 1) {
+        fprintf(stderr, "옵션 값이 범위를 벗어났습니다. (클라이언트 1~%d, 방 1~클라이언트 수, rate 1~1000)\n", MAX_CLIENTS);
+        return 1;
+    }
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(NULL));
+
+    if (!attach) {
+        server_pid = spawn_server();
+        if (server_pid == -1 || wait_for_port(5000) == -1) {
+            fprintf(stderr, "server '%s'를 띄울 수 없습니다.\n", server_path);
+            return 1;
+        }
+    }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    clients = calloc(num_clients, sizeof(*clients));
+    rooms = calloc(num_rooms, sizeof(*rooms));
+    if (epfd == -1 || clients == NULL || rooms == NULL) {
+        fprintf(stderr, "초기화 실패\n");
+        return 1;
+    }
+    for (int i = 0; i < num_rooms; i++) rooms[i].leader = i;
+
+    // 1. 접속: 모두 한꺼번에 붙이고 측정 방에 들어갈 때까지 기다린다.
+    st.connect_start = now_ns();
+    for (int i = 0; i < num_clients; i++) {
+        struct bclient* c = &clients[i];
+        c->id = i;
+        c->room = i % num_rooms;
+        snprintf(c->nick, sizeof(c->nick), "b%d", i);
+        client_open(c);
+    }
+    run_loop(st.connect_start + CONNECT_TIMEOUT_MS * 1000000LL, PH_CONNECT);
+    for (int i = 0; i < num_clients; i++) {
+        if (clients[i].fd != -1 && clients[i].enters < 2) st.connect_failed++;
+    }
+
+    // 2. 입장 알림이 다 지나가도록 잠시 기다린 뒤 채팅, 퀴즈 순서로 측정한다.
+    phase = PH_SETTLE;
+    run_loop(now_ns() + SETTLE_MS * 1000000LL, PH_DONE);
+
+    long long start = now_ns();
+    for (int i = 0; i < num_clients; i++) {
+        clients[i].next_send = start + rand() % (1000000000LL / rate);
+    }
+    phase = PH_CHAT;
+    run_loop(start + duration * 1000000000LL, PH_DONE);
+
+    phase = PH_QUIZ;
+    run_loop(now_ns() + duration * 1000000000LL, PH_DONE);
+    phase = PH_DONE;
+
+    for (int i = 0; i < num_clients; i++) {
+        client_close(&clients[i]);
+        free(clients[i].in);
+    }
+    if (server_pid > 0) {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, NULL, 0);
+    }
+
+    FILE* out = out_path ? fopen(out_path, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "'%s'를 만들 수 없습니다. (%s)\n", out_path, strerror(errno));
+        return 1;
+    }
+    report(out);
+    if (out != stdout) fclose(out);
+
+    int worse = baseline_path ? compare_baseline(baseline_path) : 0;
+    free(clients);
+    free(rooms);
+    return worse ? 2 : 0;
+}
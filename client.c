@@ -2,14 +2,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/resource.h>
+#include "protocol.h"
 
 #define BUF_SIZE 1024
-
-void *recv_msg(void *arg);
-void *send_msg(void *arg);
-void error_handling(const char *msg);
+#define OUT_SIZE (BUF_SIZE * 8)     // 연결별 송신 버퍼
+#define MAX_BOTS 10000
+#define DEFAULT_RATE 1              // 봇 한 명이 초당 보내는 메시지 수, --rate
 
 // 색상 매크로
 #define RESET   "\033[0m"
@@ -20,94 +25,434 @@ void error_handling(const char *msg);
 #define PURPLE  "\033[1;35m"
 #define CYAN    "\033[1;36m"
 
+// 서버 연결 하나. 대화형 모드는 하나, 봇 모드는 봇마다 하나씩 둔다.
+// 모든 연결을 한 스레드의 poll 루프가 처리한다.
+struct peer {
+    int fd;
+    char *in;               // 받은 바이트 (프레임 단위로 잘라 쓴다)
+    size_t in_len;
+    size_t in_cap;
+    int synced;             // FR_HELLO를 받아 프레임 경계에 맞춰짐
+    char out[OUT_SIZE];     // 아직 못 보낸 바이트
+    size_t out_len;
+    long long next_send;    // 봇: 다음 메시지를 보낼 시각(ms)
+    int line;               // 봇: 스크립트에서 다음에 보낼 줄
+    unsigned long sent;
+    unsigned long received;
+};
+
+struct peer *peers;
+int num_peers = 0;
+int bot_mode = 0;
+int rate = DEFAULT_RATE;
+char **script;              // 봇이 돌아가며 보낼 줄
+int script_len = 0;
+volatile sig_atomic_t stop = 0;
+
+const char *default_script[] = { "안녕하세요", "!score", "반갑습니다", "!rank" };
+
+int peer_connect(struct peer *p, struct sockaddr_in *addr);
+void peer_close(struct peer *p);
+void peer_send_line(struct peer *p, const char *line, size_t len);
+int peer_flush(struct peer *p);
+int peer_read(struct peer *p);
+void print_frame(uint8_t type, const char *msg);
+void load_script(const char *path);
+void run(int use_stdin);
+long long now_ms(void);
+void on_signal(int sig);
+void error_handling(const char *msg);
+
 int main(int argc, char *argv[]) {
-    int sock;
     struct sockaddr_in serv_addr;
-    pthread_t snd_thread, rcv_thread;
-    void *thread_return;
+    const char *script_path = NULL;
+    int bots = 0;
 
-    if (argc != 3) {
-        printf("사용법: %s <서버IP> <포트>\n", argv[0]);
+    if (argc < 3) {
+        printf("사용법: %s <서버IP> <포트> [--bot 인원] [--script 파일] [--rate 초당메시지]\n", argv[0]);
+        exit(1);
+    }
+    for (int i = 3; i < argc; i++) {
+        if (!strcmp(argv[i], "--bot") && i + 1 < argc) {
+            bots = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--script") && i + 1 < argc) {
+            script_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate = atoi(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "알 수 없는 옵션: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (script_path && bots <= 0)
+        bots = 1;
+    bot_mode = bots > 0;
+    if (bots > MAX_BOTS || rate <= 0 || rate > 1000) {
+        fprintf(stderr, "봇은 1~%d명, --rate는 1~1000 사이여야 합니다.\n", MAX_BOTS);
         exit(1);
     }
-
-    sock = socket(PF_INET, SOCK_STREAM, 0);
-    if (sock == -1)
-        error_handling("socket() 오류");
 
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = inet_addr(argv[1]);
     serv_addr.sin_port = htons(atoi(argv[2]));
 
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
-        error_handling("connect() 오류");
+    if (bot_mode) {
+        if (script_path) {
+            load_script(script_path);
+        }
+        else {
+            script = (char **)default_script;
+            script_len = sizeof(default_script) / sizeof(default_script[0]);
+        }
+        // 봇마다 소켓 하나씩 쓰므로 열 수 있는 fd 수를 최대로 올린다.
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+
+    num_peers = bot_mode ? bots : 1;
+    peers = calloc(num_peers, sizeof(*peers));
+    if (peers == NULL)
+        error_handling("메모리 부족");
 
-    // 수신/송신 스레드 생성
-    pthread_create(&rcv_thread, NULL, recv_msg, (void *)&sock);
-    pthread_create(&snd_thread, NULL, send_msg, (void *)&sock);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    srand(time(NULL));
+
+    long long now = now_ms();
+    for (int i = 0; i < num_peers; i++) {
+        struct peer *p = &peers[i];
+        if (peer_connect(p, &serv_addr) == -1)
+            error_handling("connect() 오류");
+
+        // 프레임 프로토콜로 협상한다. 메시지 종류를 문자열 검색 없이 바로 안다.
+        memcpy(p->out, PROTO_HELLO "\n", strlen(PROTO_HELLO "\n"));
+        p->out_len = strlen(PROTO_HELLO "\n");
+        if (bot_mode) {
+            char nick[32];
+            int len = snprintf(nick, sizeof(nick), "bot%d", i + 1);
+            peer_send_line(p, nick, len);
+            // 첫 메시지 시각을 흩어 놓아 모든 봇이 한꺼번에 보내지 않게 한다.
+            p->next_send = now + rand() % (1000 / rate + 1);
+            p->line = i % script_len;
+        }
+    }
 
-    pthread_join(snd_thread, &thread_return);
-    pthread_cancel(rcv_thread);
-    close(sock);
+    run(!bot_mode);
+
+    if (bot_mode) {
+        unsigned long sent = 0, received = 0;
+        int alive = 0;
+        for (int i = 0; i < num_peers; i++) {
+            sent += peers[i].sent;
+            received += peers[i].received;
+            if (peers[i].fd != -1)
+                alive++;
+        }
+        printf("봇 %d명 (연결 유지 %d명): 보낸 메시지 %lu개, 받은 메시지 %lu개\n",
+            num_peers, alive, sent, received);
+    }
+    for (int i = 0; i < num_peers; i++)
+        peer_close(&peers[i]);
+    free(peers);
     return 0;
 }
 
-void *send_msg(void *arg) {
-    int sock = *((int *)arg);
-    char msg[BUF_SIZE];
+// 이벤트 루프: stdin(대화형)과 모든 서버 소켓을 poll 하나로 기다린다.
+// 봇은 다음 보낼 시각까지 기다리다가 스크립트의 다음 줄을 보낸다.
+void run(int use_stdin) {
+    struct pollfd *fds = calloc(num_peers + 1, sizeof(*fds));
+    char line[BUF_SIZE];
+    size_t line_len = 0;
+    int stdin_open = use_stdin;
 
-    while (1) {
-        printf(GREEN "[Me] > " RESET);
-        fflush(stdout);
+    if (fds == NULL)
+        error_handling("메모리 부족");
+
+    while (!stop) {
+        int base = stdin_open ? 1 : 0;
+        int alive = 0;
+        long long now = now_ms();
+        long long wake = -1;
+
+        if (stdin_open) {
+            fds[0].fd = STDIN_FILENO;
+            fds[0].events = POLLIN;
+        }
+        for (int i = 0; i < num_peers; i++) {
+            struct peer *p = &peers[i];
+            if (bot_mode && p->fd != -1 && p->synced && p->next_send <= now) {
+                const char *msg = script[p->line];
+                peer_send_line(p, msg, strlen(msg));
+                p->sent++;
+                p->line = (p->line + 1) % script_len;
+                p->next_send += 1000 / rate;
+                if (p->next_send <= now)
+                    p->next_send = now + 1000 / rate;
+            }
+            if (bot_mode && p->fd != -1 && p->synced && (wake == -1 || p->next_send < wake))
+                wake = p->next_send;
 
-        fgets(msg, BUF_SIZE, stdin);
+            fds[base + i].fd = p->fd;   // 닫힌 연결은 -1이라 poll이 건너뛴다
+            fds[base + i].events = POLLIN | (p->out_len ? POLLOUT : 0);
+            fds[base + i].revents = 0;
+            if (p->fd != -1)
+                alive++;
+        }
+        if (alive == 0)
+            break;
 
-        if (!strcmp(msg, "!exit\n")) {
-            write(sock, msg, strlen(msg));
+        int timeout = wake == -1 ? -1 : (int)(wake > now ? wake - now : 0);
+        int n = poll(fds, base + num_peers, timeout);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll() 오류");
             break;
         }
 
-        write(sock, msg, strlen(msg));
+        if (stdin_open && fds[0].revents) {
+            ssize_t got = read(STDIN_FILENO, line + line_len, sizeof(line) - 1 - line_len);
+            if (got <= 0) {
+                // 입력이 끝나면 종료를 알리고 서버가 연결을 닫을 때까지 받는다.
+                peer_send_line(&peers[0], "!exit", 5);
+                stdin_open = 0;
+            }
+            else {
+                line_len += got;
+                char *start = line;
+                char *nl;
+                while ((nl = memchr(start, '\n', line + line_len - start)) != NULL) {
+                    size_t len = nl - start;
+                    if (len > 0 && start[len - 1] == '\r')
+                        len--;
+                    peer_send_line(&peers[0], start, len);
+                    if (len == 5 && !strncmp(start, "!exit", 5))
+                        stdin_open = 0;
+                    start = nl + 1;
+                }
+                line_len -= start - line;
+                memmove(line, start, line_len);
+                // 줄이 버퍼보다 길면 잘라서 보낸다.
+                if (line_len == sizeof(line) - 1) {
+                    peer_send_line(&peers[0], line, line_len);
+                    line_len = 0;
+                }
+                if (stdin_open) {
+                    printf(GREEN "[Me] > " RESET);
+                    fflush(stdout);
+                }
+            }
+        }
+
+        for (int i = 0; i < num_peers; i++) {
+            struct peer *p = &peers[i];
+            short ev = fds[base + i].revents;
+            if (p->fd == -1 || ev == 0)
+                continue;
+            if ((ev & POLLOUT) && peer_flush(p) == -1) {
+                peer_close(p);
+                continue;
+            }
+            if ((ev & (POLLIN | POLLHUP | POLLERR)) && peer_read(p) == -1)
+                peer_close(p);
+        }
     }
 
-    return NULL;
+    free(fds);
 }
 
-void *recv_msg(void *arg) {
-    int sock = *((int *)arg);
-    char msg[BUF_SIZE];
-    int str_len;
+int peer_connect(struct peer *p, struct sockaddr_in *addr) {
+    p->fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (p->fd == -1)
+        return -1;
+    fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) | O_NONBLOCK);
+    if (connect(p->fd, (struct sockaddr *)addr, sizeof(*addr)) == -1 && errno != EINPROGRESS) {
+        close(p->fd);
+        p->fd = -1;
+        return -1;
+    }
+    return 0;
+}
 
-    while (1) {
-        str_len = read(sock, msg, BUF_SIZE - 1);
-        if (str_len <= 0) return NULL;
-        msg[str_len] = 0;
+void peer_close(struct peer *p) {
+    if (p->fd != -1)
+        close(p->fd);
+    p->fd = -1;
+    free(p->in);
+    p->in = NULL;
+    p->in_len = p->in_cap = 0;
+}
 
-        if (strstr(msg, "입장하였습니다")) {
-            printf(BLUE "%s" RESET, msg);
-        }
-        else if (strstr(msg, "나갔습니다")) {
-            printf(PURPLE "%s" RESET, msg);
-        }
-        else if (strstr(msg, "정답!") || strstr(msg, "🎉")) {
-            printf(YELLOW "%s" RESET, msg);
+// 줄 하나를 FR_LINE 프레임 하나로 송신 버퍼에 넣고 보내 본다.
+// 버퍼가 차 있으면 그 줄은 버린다 (봇이 서버보다 빠를 때).
+void peer_send_line(struct peer *p, const char *line, size_t len) {
+    uint8_t hdr[FRAME_HDR_MAX];
+    if (len > BUF_SIZE - 1)
+        len = BUF_SIZE - 1;
+    int hdr_len = frame_header(hdr, FR_LINE, len);
+    if (p->fd == -1 || p->out_len + hdr_len + len > sizeof(p->out))
+        return;
+    memcpy(p->out + p->out_len, hdr, hdr_len);
+    memcpy(p->out + p->out_len + hdr_len, line, len);
+    p->out_len += hdr_len + len;
+    if (peer_flush(p) == -1)
+        peer_close(p);
+}
+
+// 송신 버퍼를 보낼 수 있는 만큼 보낸다. 오류면 -1.
+int peer_flush(struct peer *p) {
+    size_t off = 0;
+    while (off < p->out_len) {
+        ssize_t n = write(p->fd, p->out + off, p->out_len - off);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN)
+                break;
+            return -1;
         }
-        else if (strstr(msg, "[퀴즈]")) {
-            printf(CYAN "%s" RESET, msg);
+        off += n;
+    }
+    memmove(p->out, p->out + off, p->out_len - off);
+    p->out_len -= off;
+    return 0;
+}
+
+// 받은 바이트를 모아 프레임 단위로 잘라 처리한다. 한 번의 read에 프레임이
+// 여러 개 오거나 한 프레임이 여러 번에 나뉘어 와도 된다. 연결이 끝나면 -1.
+int peer_read(struct peer *p) {
+    while (1) {
+        if (p->in_cap - p->in_len < BUF_SIZE) {
+            size_t cap = p->in_cap ? p->in_cap * 2 : BUF_SIZE * 4;
+            char *bigger = realloc(p->in, cap);
+            if (bigger == NULL)
+                return -1;
+            p->in = bigger;
+            p->in_cap = cap;
         }
-        else if (strstr(msg, "[점수판]") || strstr(msg, "[🏆")) {
-            printf(YELLOW "%s" RESET, msg);
+        ssize_t str_len = read(p->fd, p->in + p->in_len, p->in_cap - p->in_len - 1);
+        if (str_len == -1 && errno == EINTR)
+            continue;
+        if (str_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (str_len <= 0)
+            return -1;
+        p->in_len += str_len;
+
+        // 협상 전에 텍스트로 온 안내문은 FR_HELLO의 0 바이트까지 버린다.
+        size_t pos = 0;
+        if (!p->synced) {
+            char *zero = memchr(p->in, 0, p->in_len);
+            if (zero == NULL) {
+                p->in_len = 0;
+                continue;
+            }
+            pos = zero - p->in;
+            p->synced = 1;
         }
-        else {
-            printf("%s", msg);
+
+        while (pos < p->in_len) {
+            uint8_t type;
+            uint32_t len;
+            int hdr_len = frame_parse((uint8_t *)p->in + pos, p->in_len - pos, &type, &len);
+            if (hdr_len < 0) {
+                fputs(RED "잘못된 프레임을 받았습니다.\n" RESET, stderr);
+                return -1;
+            }
+            if (hdr_len == 0 || p->in_len - pos - hdr_len < len)
+                break;
+
+            // 본문 뒤 한 바이트를 잠깐 '\0'으로 바꿔 문자열로 쓴다 (버퍼 끝에 한 바이트 여유가 있다).
+            char *body = p->in + pos + hdr_len;
+            char saved = body[len];
+            body[len] = 0;
+            p->received++;
+            if (!bot_mode)
+                print_frame(type, body);
+            body[len] = saved;
+            pos += hdr_len + len;
         }
+        memmove(p->in, p->in + pos, p->in_len - pos);
+        p->in_len -= pos;
+    }
+}
 
-        printf(GREEN "[Me] > " RESET);
+// 프레임 종류에 따라 색을 입혀 출력한다.
+void print_frame(uint8_t type, const char *msg) {
+    switch (type) {
+    case FR_HELLO:
+        return;
+    case FR_PROMPT:
+        printf("%s", msg);
         fflush(stdout);
+        return;
+    case FR_ENTER:
+        printf(BLUE "%s" RESET, msg);
+        break;
+    case FR_LEAVE:
+        printf(PURPLE "%s" RESET, msg);
+        break;
+    case FR_CORRECT:
+    case FR_BOARD:
+        printf(YELLOW "%s" RESET, msg);
+        break;
+    case FR_QUIZ:
+        printf(CYAN "%s" RESET, msg);
+        break;
+    case FR_ERROR:
+        printf(RED "%s" RESET, msg);
+        break;
+    default:
+        printf("%s", msg);
+        break;
     }
 
-    return NULL;
+    printf(GREEN "[Me] > " RESET);
+    fflush(stdout);
+}
+
+// 한 줄에 메시지 하나인 스크립트 파일을 읽는다. 빈 줄은 건너뛴다.
+void load_script(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char buf[BUF_SIZE];
+    int cap = 0;
+
+    if (fp == NULL)
+        error_handling("스크립트 파일을 열 수 없습니다");
+    while (fgets(buf, sizeof(buf), fp)) {
+        buf[strcspn(buf, "\r\n")] = 0;
+        if (buf[0] == 0)
+            continue;
+        if (script_len == cap) {
+            cap = cap ? cap * 2 : 16;
+            script = realloc(script, sizeof(*script) * cap);
+            if (script == NULL)
+                error_handling("메모리 부족");
+        }
+        script[script_len++] = strdup(buf);
+    }
+    fclose(fp);
+    if (script_len == 0)
+        error_handling("스크립트 파일이 비어 있습니다");
+}
+
+long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
 }
 
 void error_handling(const char *msg) {
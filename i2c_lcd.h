@@ -0,0 +1,59 @@
+// /dev/i2c_lcd_display 사용자 공간 인터페이스
+// 커널 모듈(i2c_lcd_driver.c)과 server.c가 함께 쓴다.
+// write()로 보낸 화면은 드라이버 큐에 들어가고 워크큐가 패널에 그린다.
+// write()는 기다리지 않으며, 아직 그리지 않은 화면은 새 화면으로 덮인다.
+//
+// 화면 갱신 방법은 두 가지다.
+// - write(): 텍스트. '\n'에서 다음 줄로 가고, 줄이 16글자를 넘으면 이어서 다음
+//   줄에 쓴다. 남는 칸은 공백이다.
+// - mmap(): 장치를 MAP_SHARED로 매핑하면 맨 앞 LCD_ROWS × LCD_COLS 바이트가
+//   셀 버퍼다. 셀을 고친 뒤 LCD_IOC_FLUSH로 고친 구간을 알리면 그 구간만
+//   마지막 화면 위에 덮어 큐에 넣는다. 문자열을 만들 필요가 없다.
+// 셀 값 0~7(과 같은 글리프를 가리키는 8~15)은 LCD_IOC_SET_GLYPH로 올린
+// 사용자 글리프다.
+
+#ifndef I2C_LCD_H
+#define I2C_LCD_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define LCD_ROWS 2
+#define LCD_COLS 16
+#define LCD_CELLS (LCD_ROWS * LCD_COLS)
+#define LCD_GLYPHS 8        // CGRAM 글리프 수 (5×8 점)
+
+// 화면 우선순위. 새 화면은 같거나 낮은 우선순위의 대기 화면을 버린다.
+// 보통/높음 화면은 그린 뒤 잠시(1초/3초) 그보다 낮은 우선순위 화면에 가려지지
+// 않는다. 예: 정답자 발표(높음)가 곧이어 온 접속자 수(낮음)에 바로 덮이지 않음.
+enum lcd_prio {
+    LCD_PRIO_LOW,       // 접속자 수처럼 자주 바뀌는 상태
+    LCD_PRIO_NORMAL,    // 기본값, 점수판/순위
+    LCD_PRIO_HIGH,      // 퀴즈 출제, 정답자 발표
+    LCD_PRIO_LEVELS
+};
+
+#define LCD_IOC_MAGIC 'L'
+
+// 셀 번호(row * LCD_COLS + col) [first, first + count) 구간
+struct lcd_region {
+    __u8 first;
+    __u8 count;
+};
+
+// 글리프 하나. rows[i]의 아래 5비트가 i번째 줄의 점이다.
+struct lcd_glyph {
+    __u8 index;         // 0 ~ LCD_GLYPHS-1
+    __u8 rows[8];
+};
+
+// 이 파일 디스크립터로 쓰는 화면의 우선순위를 정한다. 인자는 enum lcd_prio 값.
+#define LCD_IOC_SET_PRIO _IO(LCD_IOC_MAGIC, 1)
+// mmap한 셀 버퍼에서 고친 구간을 화면 큐에 넣는다. 이 파일의 우선순위를 따른다.
+#define LCD_IOC_FLUSH _IOW(LCD_IOC_MAGIC, 2, struct lcd_region)
+// CGRAM 글리프를 올린다. 그 글리프를 쓰는 셀은 다시 그리지 않아도 바뀐다.
+#define LCD_IOC_SET_GLYPH _IOW(LCD_IOC_MAGIC, 3, struct lcd_glyph)
+// 백라이트를 켜거나(인자 1) 끈다(인자 0).
+#define LCD_IOC_SET_BACKLIGHT _IO(LCD_IOC_MAGIC, 4)
+
+#endif
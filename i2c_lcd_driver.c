@@ -9,10 +9,18 @@
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 #include <linux/cdev.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/jiffies.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/compat.h>
+#include "i2c_lcd.h"
 
 // --- LCD 설정 ---
 #define LCD_I2C_ADDR 0x27
-#define MAX_MSG_LEN  32
+#define MAX_MSG_LEN  (LCD_ROWS * (LCD_COLS + 1))    // 줄마다 '\n' 하나
 #define LCD_MAJOR    240
 #define DEVICE_NAME  "i2c_lcd_display"
 
@@ -22,6 +30,11 @@
 #define EN_BIT       (1 << 2)
 #define BL_BIT       (1 << 3)
 
+// 한 번에 모아 보내는 PCF8574 출력 바이트 수. 니블 하나가 EN high/low 두
+// 바이트라 LCD 명령/글자 하나는 4바이트다. 모든 칸에 커서 명령이 붙는 최악의
+// 경우에도 화면 전체가 한 번에 들어간다.
+#define LCD_BATCH_MAX (LCD_ROWS * LCD_COLS * 2 * 4)
+
 // LCD 명령어
 #define LCD_CMD_CLEARDISPLAY   0x01
 #define LCD_CMD_RETURNHOME     0x02
@@ -32,42 +45,166 @@
 static struct i2c_client *lcd_i2c_client;
 static struct workqueue_struct *lcd_wq;
 static struct delayed_work lcd_work;
-static char current_lcd_message[MAX_MSG_LEN + 1];
+static struct work_struct lcd_init_work;
 static struct cdev lcd_cdev;
 static dev_t lcd_dev_num;
 
-static int i2c_lcd_write_byte(u8 data, u8 mode)
+// 패널에 지금 떠 있는 글자. 새 메시지와 비교해 바뀐 칸만 보낸다.
+// 0은 알 수 없는 칸이라 다음 갱신 때 무조건 다시 쓴다.
+static char lcd_shadow[LCD_ROWS][LCD_COLS];
+static int lcd_cur_row = -1;   // 다음 글자가 찍힐 위치, 모르면 -1
+static int lcd_cur_col = -1;
+
+// --- 화면 큐 ---
+// write()는 화면을 큐에 넣고 워크큐를 깨우기만 하므로 그리는 중이어도 기다리지
+// 않는다. 새 화면은 같거나 낮은 우선순위의 대기 화면을 버리므로(최신 화면이
+// 이김) 큐는 앞에서부터 우선순위가 높은 순이고 우선순위 수보다 길어지지 않는다.
+// 큐는 lcd_queue_lock으로 보호하고, 패널과 그림자 버퍼는 워크큐만 만진다.
+struct lcd_frame {
+    char cells[LCD_ROWS][LCD_COLS];
+    int prio;
+};
+
+static struct lcd_frame lcd_queue[LCD_PRIO_LEVELS];
+static int lcd_queue_len;
+static bool lcd_busy;                   // 큐에서 꺼낸 화면을 그리는 중
+static DEFINE_SPINLOCK(lcd_queue_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lcd_idle_wq);   // 큐가 비고 다 그렸을 때 깨운다
+
+// 마지막으로 큐에 넣은 화면. LCD_IOC_FLUSH는 이 위에 고친 구간만 덮는다.
+static char lcd_target[LCD_ROWS][LCD_COLS];
+
+// mmap으로 사용자에게 보이는 셀 버퍼(한 페이지). 모듈이 살아 있는 동안 유지한다.
+static char *lcd_fb;
+
+// 워크큐가 다음에 반영할 글리프와 백라이트 요청. lcd_queue_lock으로 보호한다.
+static u8 lcd_glyphs[LCD_GLYPHS][8];
+static u8 lcd_glyph_dirty;              // 올려야 할 글리프 비트마스크
+static int lcd_bl_req = -1;             // 0/1, 요청이 없으면 -1
+
+// 우선순위별로 그린 뒤 더 낮은 화면에 가려지지 않는 시간
+static const unsigned int lcd_hold_ms[LCD_PRIO_LEVELS] = { 0, 1000, 3000 };
+static int lcd_shown_prio = LCD_PRIO_LOW;      // 워크큐만 읽고 쓴다
+static unsigned long lcd_hold_until;
+
+// --- 버스 전송 ---
+// 명령과 글자는 바로 보내지 않고 EN 스트로브까지 펼친 바이트열로 lcd_batch에
+// 모은 뒤 lcd_flush()에서 한 번에 보낸다. 어댑터가 일반 I2C 전송을 지원하면
+// 한 덩어리를 i2c_master_send 한 번으로, SMBus만 되면 I2C 블록 쓰기(최대
+// 33바이트)로, 그것도 안 되면 바이트마다 SMBus 쓰기로 보낸다.
+//
+// PCF8574는 100kHz 장치라 한 바이트 전송에 약 90us가 걸리고, HD44780이 명령
+// 하나를 처리하는 시간(37us)과 EN 펄스 폭(450ns)은 그 안에 끝난다. 그래서
+// 바이트 사이에는 따로 기다리지 않는다. clear/home과 초기화처럼 오래 걸리는
+// 단계에서만 버퍼를 비우고 잔다. 전송은 모두 워크큐(프로세스 문맥)에서 하므로
+// 기다리는 동안 CPU를 돌리지 않고 usleep_range/msleep으로 양보한다.
+
+enum lcd_bus_mode {
+    LCD_BUS_I2C,        // i2c_master_send 한 번에 한 덩어리
+    LCD_BUS_I2C_BLOCK,  // 첫 바이트를 명령 바이트 자리에 넣은 SMBus 블록 쓰기
+    LCD_BUS_BYTE,       // 바이트마다 i2c_smbus_write_byte
+};
+
+static enum lcd_bus_mode lcd_bus = LCD_BUS_BYTE;
+static size_t lcd_batch_limit = LCD_BATCH_MAX;  // 전송 한 번의 최대 바이트 수
+static u8 lcd_batch[LCD_BATCH_MAX];
+static u8 lcd_backlight = BL_BIT;   // 출력 바이트마다 붙는 백라이트 비트, 워크큐만 바꾼다
+static size_t lcd_batch_len;
+static int lcd_batch_err;   // 버퍼가 차서 중간에 보내다 난 오류, lcd_flush가 돌려준다
+
+// 어댑터가 지원하는 가장 빠른 전송 방식을 고른다.
+static int lcd_bus_setup(struct i2c_client *client)
+{
+    const struct i2c_adapter_quirks *q = client->adapter->quirks;
+
+    if (i2c_check_functionality(client->adapter, I2C_FUNC_I2C)) {
+        lcd_bus = LCD_BUS_I2C;
+        lcd_batch_limit = LCD_BATCH_MAX;
+        if (q && q->max_write_len && q->max_write_len < lcd_batch_limit)
+            lcd_batch_limit = q->max_write_len;
+    } else if (i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_I2C_BLOCK)) {
+        lcd_bus = LCD_BUS_I2C_BLOCK;
+        lcd_batch_limit = I2C_SMBUS_BLOCK_MAX + 1;
+    } else if (i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_BYTE)) {
+        lcd_bus = LCD_BUS_BYTE;
+        lcd_batch_limit = 1;
+    } else {
+        return -EIO;
+    }
+    return 0;
+}
+
+static int lcd_bus_send(const u8 *buf, size_t len)
 {
     int ret;
-    u8 tx = data | mode | BL_BIT;
 
-    ret = i2c_smbus_write_byte(lcd_i2c_client, tx | EN_BIT);
-    if (ret < 0) {
-        pr_err("LCD write EN-high failed: %d\n", ret);
-        return ret;
+    switch (lcd_bus) {
+    case LCD_BUS_I2C:
+        ret = i2c_master_send(lcd_i2c_client, (const char *)buf, len);
+        if (ret >= 0 && ret != (int)len)
+            ret = -EIO;
+        return ret < 0 ? ret : 0;
+    case LCD_BUS_I2C_BLOCK:
+        if (len == 1)
+            return i2c_smbus_write_byte(lcd_i2c_client, buf[0]);
+        return i2c_smbus_write_i2c_block_data(lcd_i2c_client, buf[0], len - 1, buf + 1);
+    default:
+        // SMBus 바이트 쓰기 한 번(주소 + 데이터)이 EN 펄스 폭과 명령 처리
+        // 시간보다 길어서 전송 사이에 기다리지 않는다.
+        return i2c_smbus_write_byte(lcd_i2c_client, buf[0]);
     }
-    udelay(5);
+}
 
-    ret = i2c_smbus_write_byte(lcd_i2c_client, tx & ~EN_BIT);
-    if (ret < 0) {
-        pr_err("LCD write EN-low failed: %d\n", ret);
-        return ret;
+// 모아 둔 바이트를 보낸다. 보내는 중 오류가 나면 나머지는 버린다.
+static int lcd_flush(void)
+{
+    size_t off = 0;
+    int ret = lcd_batch_err;
+
+    while (ret == 0 && off < lcd_batch_len) {
+        size_t n = min_t(size_t, lcd_batch_len - off, lcd_batch_limit);
+        ret = lcd_bus_send(lcd_batch + off, n);
+        off += n;
     }
-    udelay(200);
-    return 0;
+    lcd_batch_len = 0;
+    lcd_batch_err = 0;
+    if (ret < 0)
+        pr_err("I2C LCD: Bus write failed: %d\n", ret);
+    return ret;
+}
+
+// 니블 하나(data의 위 4비트)를 EN high, EN low 두 바이트로 쌓는다.
+static void lcd_queue_nibble(u8 data, u8 mode)
+{
+    u8 tx = data | mode | lcd_backlight;
+
+    if (lcd_batch_len + 2 > LCD_BATCH_MAX) {
+        int ret = lcd_flush();
+        if (ret < 0)
+            lcd_batch_err = ret;
+    }
+    lcd_batch[lcd_batch_len++] = tx | EN_BIT;
+    lcd_batch[lcd_batch_len++] = tx & ~EN_BIT;
 }
 
 static void lcd_send_nibbles(u8 val, u8 mode)
 {
-    i2c_lcd_write_byte(val & 0xF0, mode);
-    i2c_lcd_write_byte((val << 4) & 0xF0, mode);
+    lcd_queue_nibble(val & 0xF0, mode);
+    lcd_queue_nibble((val << 4) & 0xF0, mode);
 }
 
-static void lcd_send_cmd(u8 cmd)
+// clear/home은 1.52ms 걸리므로 바로 보내고 잔다. 나머지 명령은 버퍼에
+// 쌓이기만 하고 0을 돌려준다.
+static int lcd_send_cmd(u8 cmd)
 {
+    int ret;
+
     lcd_send_nibbles(cmd, 0);
-    if (cmd == LCD_CMD_CLEARDISPLAY || cmd == LCD_CMD_RETURNHOME)
-        mdelay(3);
+    if (cmd != LCD_CMD_CLEARDISPLAY && cmd != LCD_CMD_RETURNHOME)
+        return 0;
+    ret = lcd_flush();
+    usleep_range(2000, 3000);
+    return ret;
 }
 
 static void lcd_send_data(u8 data)
@@ -81,58 +218,247 @@ static void lcd_set_cursor(u8 col, u8 row)
     lcd_send_cmd(addr);
 }
 
-static void lcd_print_string(const char *s)
+// 메시지를 화면 한 장으로 편다. '\n'에서 다음 줄로 가고, 16글자가 찬 줄은 다음
+// 글자가 올 때 넘긴다(16글자 뒤의 '\n'은 빈 줄을 만들지 않는다). 남는 칸은 공백이다.
+static void lcd_render(const char *msg, char frame[LCD_ROWS][LCD_COLS])
 {
-    while (*s) {
-        lcd_send_data(*s++);
+    size_t len = strnlen(msg, MAX_MSG_LEN);
+    size_t i;
+    int row = 0, col = 0;
+
+    memset(frame, ' ', LCD_ROWS * LCD_COLS);
+    for (i = 0; i < len && row < LCD_ROWS; ++i) {
+        if (msg[i] == '\n') {
+            row++;
+            col = 0;
+            continue;
+        }
+        if (col == LCD_COLS) {
+            if (++row == LCD_ROWS)
+                break;
+            col = 0;
+        }
+        frame[row][col++] = msg[i];
     }
 }
 
-static void lcd_display_user_message_fn(struct work_struct *work)
+// CGRAM 주소를 지정해 글리프를 올린다. 그 뒤 주소 카운터가 CGRAM을 가리키므로
+// 커서 위치를 모르는 것으로 두어 다음 갱신이 DDRAM 주소부터 다시 잡게 한다.
+// 화면에 떠 있는 그 글리프 칸은 HD44780이 알아서 새 모양으로 보여 준다.
+static void lcd_upload_glyph(int index, const u8 rows[8])
 {
-    size_t len = strlen(current_lcd_message);
-    size_t i;
+    int i;
 
-    pr_info("I2C LCD: Displaying user message: '%s'\n", current_lcd_message);
+    lcd_send_cmd(0x40 | (index << 3));
+    for (i = 0; i < 8; ++i)
+        lcd_send_data(rows[i] & 0x1F);
+    lcd_cur_row = lcd_cur_col = -1;
+}
 
-    lcd_send_cmd(LCD_CMD_CLEARDISPLAY);
-    mdelay(5);
-    lcd_send_cmd(LCD_CMD_RETURNHOME);
-    mdelay(5);
+// 백라이트 비트만 바꾼 바이트를 EN 없이 한 번 내보낸다.
+static void lcd_set_backlight(bool on)
+{
+    lcd_backlight = on ? BL_BIT : 0;
+    if (lcd_batch_len == LCD_BATCH_MAX)
+        lcd_flush();
+    lcd_batch[lcd_batch_len++] = lcd_backlight;
+}
+
+// 패널을 frame으로 바꾼다. 그림자 버퍼와 다른 칸만 보내고, 커서는 바뀐 칸이
+// 이어지지 않을 때만 옮긴다. 한 칸만 건너뛸 때는 커서 명령과 같은 비용이므로
+// 그 칸을 다시 써서 커서를 넘긴다. 느린 clear/home 명령은 쓰지 않는다.
+// 바뀐 칸을 모두 쌓은 뒤 한 번에 보내며, 실패하면 패널 상태를 알 수 없으므로
+// 다음 갱신에서 전부 다시 쓴다.
+static int lcd_update(const char frame[LCD_ROWS][LCD_COLS])
+{
+    int row, col, ret, sent = 0;
+
+    for (row = 0; row < LCD_ROWS; ++row) {
+        for (col = 0; col < LCD_COLS; ++col) {
+            if (frame[row][col] == lcd_shadow[row][col])
+                continue;
+            if (row != lcd_cur_row || col != lcd_cur_col) {
+                if (row == lcd_cur_row && col == lcd_cur_col + 1)
+                    lcd_send_data(lcd_shadow[row][col - 1]);
+                else
+                    lcd_set_cursor(col, row);
+            }
+            lcd_send_data(frame[row][col]);
+            lcd_shadow[row][col] = frame[row][col];
+            lcd_cur_row = row;
+            lcd_cur_col = col + 1;
+            sent++;
+        }
+    }
+
+    ret = lcd_flush();
+    if (ret < 0) {
+        memset(lcd_shadow, 0, sizeof(lcd_shadow));
+        lcd_cur_row = lcd_cur_col = -1;
+        return ret;
+    }
+    return sent;
+}
+
+// 큐가 비었고 그리는 화면도 없으면 true
+static bool lcd_idle(void)
+{
+    bool idle;
+
+    spin_lock(&lcd_queue_lock);
+    idle = lcd_queue_len == 0 && !lcd_busy && !lcd_glyph_dirty && lcd_bl_req < 0;
+    spin_unlock(&lcd_queue_lock);
+    return idle;
+}
+
+// 마지막 화면의 셀 [first, first + count)를 cells의 같은 칸으로 바꾼 화면을 큐에
+// 넣는다. 셀 값 0~7은 같은 글리프인 8~15로 바꿔 그림자 버퍼의 0(모르는 칸)과
+// 겹치지 않게 한다.
+static void lcd_enqueue(const char cells[LCD_ROWS][LCD_COLS], int first, int count, int prio)
+{
+    char *dst = &lcd_target[0][0];
+    const char *src = &cells[0][0];
+    int i;
+
+    spin_lock(&lcd_queue_lock);
+    // 장치를 제거하는 중이면 워크큐가 없다. 열려 있던 파일의 쓰기는 버린다.
+    if (!lcd_wq) {
+        spin_unlock(&lcd_queue_lock);
+        return;
+    }
+    for (i = first; i < first + count; ++i)
+        dst[i] = (u8)src[i] < LCD_GLYPHS ? src[i] + LCD_GLYPHS : src[i];
+    while (lcd_queue_len > 0 && lcd_queue[lcd_queue_len - 1].prio <= prio)
+        lcd_queue_len--;
+    memcpy(lcd_queue[lcd_queue_len].cells, lcd_target, sizeof(lcd_target));
+    lcd_queue[lcd_queue_len].prio = prio;
+    lcd_queue_len++;
+    // 보류 중인 지연 실행이 있어도 지금 다시 보게 한다.
+    mod_delayed_work(lcd_wq, &lcd_work, 0);
+    spin_unlock(&lcd_queue_lock);
+}
+
+// 텍스트를 화면 한 장으로 펴서 큐에 넣고, mmap한 셀 버퍼에도 같은 화면을 둔다.
+// 그래서 write()와 mmap을 섞어 써도 셀 버퍼가 마지막 화면과 맞는다.
+static void lcd_enqueue_text(const char *text, int prio)
+{
+    char frame[LCD_ROWS][LCD_COLS];
+
+    lcd_render(text, frame);
+    if (lcd_fb)
+        memcpy(lcd_fb, frame, sizeof(frame));
+    lcd_enqueue(frame, 0, LCD_CELLS, prio);
+}
+
+// 글리프나 백라이트 요청을 워크큐에 알린다. lcd_queue_lock을 잡고, lcd_wq가
+// 있을 때만 부른다.
+static void lcd_kick_locked(void)
+{
+    mod_delayed_work(lcd_wq, &lcd_work, 0);
+}
 
-    for (i = 0; i < len; ++i) {
-        if (i == 16) {
-            lcd_set_cursor(0, 1);
+// 큐가 빌 때까지 앞에서부터 그린다. 맨 앞 화면이 지금 떠 있는 화면보다 낮은
+// 우선순위이고 아직 보여 줄 시간이 남았으면 그때 다시 돈다.
+// 글리프와 백라이트 요청은 보류 시간과 상관없이 먼저 반영한다.
+static void lcd_display_user_message_fn(struct work_struct *work)
+{
+    struct lcd_frame f;
+    u8 glyphs[LCD_GLYPHS][8];
+    u8 glyph_mask;
+    int bl, i, sent;
+
+    for (;;) {
+        spin_lock(&lcd_queue_lock);
+        glyph_mask = lcd_glyph_dirty;
+        bl = lcd_bl_req;
+        if (glyph_mask || bl >= 0) {
+            memcpy(glyphs, lcd_glyphs, sizeof(glyphs));
+            lcd_glyph_dirty = 0;
+            lcd_bl_req = -1;
+            lcd_busy = true;
+            spin_unlock(&lcd_queue_lock);
+
+            for (i = 0; i < LCD_GLYPHS; ++i)
+                if (glyph_mask & (1 << i))
+                    lcd_upload_glyph(i, glyphs[i]);
+            if (bl >= 0)
+                lcd_set_backlight(bl);
+            if (lcd_flush() < 0) {
+                memset(lcd_shadow, 0, sizeof(lcd_shadow));
+                lcd_cur_row = lcd_cur_col = -1;
+            }
+            continue;
         }
-        if (i >= MAX_MSG_LEN) {
-            break;
+        if (lcd_queue_len == 0) {
+            lcd_busy = false;
+            spin_unlock(&lcd_queue_lock);
+            wake_up_interruptible(&lcd_idle_wq);
+            return;
         }
-        lcd_send_data(current_lcd_message[i]);
+        if (lcd_queue[0].prio < lcd_shown_prio && time_before(jiffies, lcd_hold_until)) {
+            lcd_busy = false;
+            if (lcd_wq)
+                queue_delayed_work(lcd_wq, &lcd_work, lcd_hold_until - jiffies);
+            spin_unlock(&lcd_queue_lock);
+            return;
+        }
+        f = lcd_queue[0];
+        lcd_queue_len--;
+        memmove(&lcd_queue[0], &lcd_queue[1], lcd_queue_len * sizeof(lcd_queue[0]));
+        lcd_busy = true;
+        spin_unlock(&lcd_queue_lock);
+
+        sent = lcd_update(f.cells);
+        lcd_shown_prio = f.prio;
+        lcd_hold_until = jiffies + msecs_to_jiffies(lcd_hold_ms[f.prio]);
+        if (sent < 0)
+            pr_err("I2C LCD: Update failed: %d\n", sent);
+        else
+            pr_debug("I2C LCD: Displayed frame (priority %d, %d cells changed)\n", f.prio, sent);
     }
 }
 
+// HD44780 초기화. 전원이 올라온 뒤 40ms 넘게 기다리고, 8비트 모드 니블
+// 사이에는 4.1ms, 4비트 모드로 바꾼 뒤에는 100us 넘게 기다려야 한다.
 static void lcd_init_sequence(void)
 {
     int i;
-    mdelay(100);
+    msleep(100);
 
     for (i = 0; i < 3; ++i) {
-        i2c_lcd_write_byte(0x30, 0);
-        udelay(6000);
+        lcd_queue_nibble(0x30, 0);
+        lcd_flush();
+        usleep_range(4500, 6000);
     }
-    i2c_lcd_write_byte(0x20, 0);
-    udelay(300);
+    lcd_queue_nibble(0x20, 0);
+    lcd_flush();
+    usleep_range(150, 300);
 
     lcd_send_cmd(LCD_CMD_FUNCTIONSET);
     lcd_send_cmd(LCD_CMD_DISPLAYCONTROL);
     lcd_send_cmd(LCD_CMD_CLEARDISPLAY);
-    mdelay(3);
     lcd_send_cmd(LCD_CMD_ENTRYMODESET);
+    lcd_flush();
+
+    // 지운 직후라 화면은 공백이고 커서는 첫 칸에 있다.
+    memset(lcd_shadow, ' ', sizeof(lcd_shadow));
+    lcd_cur_row = 0;
+    lcd_cur_col = 0;
+}
+
+// 초기화도 워크큐에서 해서 probe가 120ms 남짓 걸리는 초기화를 기다리지 않게
+// 한다. 워크큐는 순서대로 하나씩 실행하므로 뒤에 들어온 화면 갱신은 초기화가
+// 끝난 다음에 돈다.
+static void lcd_init_work_fn(struct work_struct *work)
+{
+    lcd_init_sequence();
 }
 
 // --- 문자 장치 파일 오퍼레이션 ---
+// 파일마다 쓰는 화면의 우선순위를 private_data에 둔다.
 static int lcd_open(struct inode *inode, struct file *file)
 {
+    file->private_data = (void *)(uintptr_t)LCD_PRIO_NORMAL;
     pr_info("I2C LCD: Device opened.\n");
     return 0;
 }
@@ -143,33 +469,128 @@ static int lcd_release(struct inode *inode, struct file *file)
     return 0;
 }
 
+// 화면을 큐에 넣고 바로 돌아온다. 버스 전송이나 이전 화면을 기다리지 않으므로
+// O_NONBLOCK이든 아니든 잠들지 않는다. 콘솔 출력도 쓰는 쪽을 늦추지 않도록
+// pr_debug로만 남긴다.
 static ssize_t lcd_write(struct file *file, const char __user *buf, size_t count, loff_t *pos)
 {
+    char text[MAX_MSG_LEN + 1];
+
     if (count > MAX_MSG_LEN) {
         pr_warn("I2C LCD: Message too long, truncating to %d characters.\n", MAX_MSG_LEN);
         count = MAX_MSG_LEN;
     }
 
-    if (copy_from_user(current_lcd_message, buf, count)) {
+    if (copy_from_user(text, buf, count)) {
         pr_err("I2C LCD: Failed to copy data from user space.\n");
         return -EFAULT;
     }
-    current_lcd_message[count] = '\0';
-
-    cancel_delayed_work_sync(&lcd_work);
-    INIT_DELAYED_WORK(&lcd_work, lcd_display_user_message_fn);
-    queue_delayed_work(lcd_wq, &lcd_work, msecs_to_jiffies(100));
+    text[count] = '\0';
 
-    pr_info("I2C LCD: Received message from user: '%s'\n", current_lcd_message);
+    lcd_enqueue_text(text, (int)(uintptr_t)file->private_data);
+    pr_debug("I2C LCD: Received message from user: '%s'\n", text);
 
     return count;
 }
 
+// 대기 화면이 없어 다음 write()가 아무것도 덮지 않을 때 쓰기 가능으로 알린다.
+// write() 자체는 언제든 받는다.
+static __poll_t lcd_poll(struct file *file, poll_table *wait)
+{
+    poll_wait(file, &lcd_idle_wq, wait);
+    return lcd_idle() ? (EPOLLOUT | EPOLLWRNORM) : 0;
+}
+
+// 지금까지 쓴 화면이 패널에 그려질 때까지 기다린다. 보류 중인 낮은 우선순위
+// 화면이 있으면 보류 시간만큼 걸린다. O_NONBLOCK이면 기다리지 않고 -EAGAIN.
+static int lcd_fsync(struct file *file, loff_t start, loff_t end, int datasync)
+{
+    if (file->f_flags & O_NONBLOCK)
+        return lcd_idle() ? 0 : -EAGAIN;
+    return wait_event_interruptible(lcd_idle_wq, lcd_idle());
+}
+
+// 셀 버퍼 한 페이지를 매핑한다. 여러 파일이 같은 버퍼를 나눠 쓴다.
+static int lcd_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_pgoff != 0)
+        return -EINVAL;
+    return remap_vmalloc_range(vma, lcd_fb, 0);
+}
+
+static long lcd_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    void __user *uarg = (void __user *)arg;
+
+    switch (cmd) {
+    case LCD_IOC_SET_PRIO:
+        if (arg >= LCD_PRIO_LEVELS)
+            return -EINVAL;
+        file->private_data = (void *)(uintptr_t)arg;
+        return 0;
+    case LCD_IOC_FLUSH: {
+        struct lcd_region r;
+        char cells[LCD_ROWS][LCD_COLS];
+
+        if (copy_from_user(&r, uarg, sizeof(r)))
+            return -EFAULT;
+        if (r.first >= LCD_CELLS || r.count > LCD_CELLS - r.first)
+            return -EINVAL;
+        if (r.count == 0)
+            return 0;
+        // 사용자가 계속 고치는 중일 수 있으므로 한 번 복사해 둔 것을 쓴다.
+        memcpy(cells, lcd_fb, sizeof(cells));
+        lcd_enqueue(cells, r.first, r.count, (int)(uintptr_t)file->private_data);
+        return 0;
+    }
+    case LCD_IOC_SET_GLYPH: {
+        struct lcd_glyph g;
+
+        if (copy_from_user(&g, uarg, sizeof(g)))
+            return -EFAULT;
+        if (g.index >= LCD_GLYPHS)
+            return -EINVAL;
+        spin_lock(&lcd_queue_lock);
+        // 장치를 제거한 뒤에는 반영할 워크큐가 없다. 요청을 남기면 lcd_idle()이
+        // 영영 참이 되지 않으므로 건드리지 않고 돌려보낸다.
+        if (!lcd_wq) {
+            spin_unlock(&lcd_queue_lock);
+            return -ENODEV;
+        }
+        memcpy(lcd_glyphs[g.index], g.rows, sizeof(g.rows));
+        lcd_glyph_dirty |= 1 << g.index;
+        lcd_kick_locked();
+        spin_unlock(&lcd_queue_lock);
+        return 0;
+    }
+    case LCD_IOC_SET_BACKLIGHT:
+        if (arg > 1)
+            return -EINVAL;
+        spin_lock(&lcd_queue_lock);
+        if (!lcd_wq) {
+            spin_unlock(&lcd_queue_lock);
+            return -ENODEV;
+        }
+        lcd_bl_req = arg;
+        lcd_kick_locked();
+        spin_unlock(&lcd_queue_lock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
 static const struct file_operations lcd_fops = {
     .owner   = THIS_MODULE,
     .open    = lcd_open,
     .release = lcd_release,
     .write   = lcd_write,
+    .poll    = lcd_poll,
+    .fsync   = lcd_fsync,
+    .mmap    = lcd_mmap,
+    .unlocked_ioctl = lcd_ioctl,
+    // 구조체 인자는 u8만 있어 32비트에서도 배치가 같다.
+    .compat_ioctl   = compat_ptr_ioctl,
 };
 
 // --- I2C 드라이버 부분 ---
@@ -180,12 +601,14 @@ static int lcd_probe(struct i2c_client *client)
     pr_info("I2C LCD: Probing LCD at address 0x%x on I2C bus %d\n",
             client->addr, i2c_adapter_id(client->adapter));
 
-    if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_BYTE_DATA)) {
-        pr_err("I2C LCD: I2C SMBus byte data functionality not supported.\n");
+    if (lcd_bus_setup(client) < 0) {
+        pr_err("I2C LCD: Adapter supports neither I2C nor SMBus byte writes.\n");
         return -EIO;
     }
-
-    lcd_init_sequence();
+    pr_info("I2C LCD: Using %s transfers (up to %zu bytes each).\n",
+            lcd_bus == LCD_BUS_I2C ? "plain I2C" :
+            lcd_bus == LCD_BUS_I2C_BLOCK ? "SMBus I2C block" : "SMBus byte",
+            lcd_batch_limit);
 
     lcd_wq = create_singlethread_workqueue("lcd_wq");
     if (!lcd_wq) {
@@ -193,10 +616,12 @@ static int lcd_probe(struct i2c_client *client)
         return -ENOMEM;
     }
 
-    strncpy(current_lcd_message, "Hello from Kernel!", MAX_MSG_LEN);
-    current_lcd_message[MAX_MSG_LEN] = '\0';
+    INIT_WORK(&lcd_init_work, lcd_init_work_fn);
+    queue_work(lcd_wq, &lcd_init_work);
+
     INIT_DELAYED_WORK(&lcd_work, lcd_display_user_message_fn);
-    queue_delayed_work(lcd_wq, &lcd_work, msecs_to_jiffies(500));
+    memset(lcd_target, ' ', sizeof(lcd_target));
+    lcd_enqueue_text("Hello from Kernel!", LCD_PRIO_NORMAL);
 
     ret = alloc_chrdev_region(&lcd_dev_num, 0, 1, DEVICE_NAME);
     if (ret < 0) {
@@ -223,16 +648,29 @@ static int lcd_probe(struct i2c_client *client)
 
 static void lcd_remove(struct i2c_client *client)
 {
+    struct workqueue_struct *wq;
+
     cdev_del(&lcd_cdev);
     unregister_chrdev_region(lcd_dev_num, 1);
 
+    // 아직 열려 있는 파일이 더는 워크큐에 일을 넣지 못하게 한 뒤 멈춘다.
+    spin_lock(&lcd_queue_lock);
+    wq = lcd_wq;
+    lcd_wq = NULL;
+    lcd_queue_len = 0;
+    lcd_glyph_dirty = 0;
+    lcd_bl_req = -1;
+    spin_unlock(&lcd_queue_lock);
+
     cancel_delayed_work_sync(&lcd_work);
-    if (lcd_wq)
-        destroy_workqueue(lcd_wq);
+    if (wq)
+        destroy_workqueue(wq);
+    lcd_busy = false;
+    wake_up_interruptible(&lcd_idle_wq);
 
     lcd_send_cmd(LCD_CMD_CLEARDISPLAY);
-    mdelay(3);
     i2c_smbus_write_byte(client, 0x00);
+    lcd_backlight = BL_BIT;
     pr_info("I2C LCD: Driver unloaded and device /dev/%s removed.\n", DEVICE_NAME);
 }
 
@@ -246,21 +684,35 @@ static struct i2c_driver lcd_driver = {
     .driver = {
         .name = "i2c_lcd",
         .owner = THIS_MODULE,
+        // 버스 지연과 초기화 대기가 부팅이나 다른 장치의 probe를 막지 않게 한다.
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS,
     },
     .probe  = lcd_probe,
     .remove = lcd_remove,
     .id_table = lcd_id,
 };
 
+// 셀 버퍼는 모듈과 수명을 같이 한다. 장치를 떼어도 열린 파일의 매핑이 남을 수
+// 있고, 열린 파일이 있으면 모듈은 내려가지 않는다.
 static int __init i2c_lcd_module_init(void)
 {
+    int ret;
+
     pr_info("I2C LCD: Initializing I2C LCD driver module.\n");
-    return i2c_add_driver(&lcd_driver);
+    lcd_fb = vmalloc_user(PAGE_SIZE);
+    if (!lcd_fb)
+        return -ENOMEM;
+    memset(lcd_fb, ' ', LCD_CELLS);
+    ret = i2c_add_driver(&lcd_driver);
+    if (ret < 0)
+        vfree(lcd_fb);
+    return ret;
 }
 
 static void __exit i2c_lcd_module_exit(void)
 {
     i2c_del_driver(&lcd_driver);
+    vfree(lcd_fb);
     pr_info("I2C LCD: Exiting I2C LCD driver module.\n");
 }
 
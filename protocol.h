@@ -0,0 +1,70 @@
+// 프레임 프로토콜
+// 기본은 한 줄 단위의 텍스트 프로토콜이다. 닉네임을 정하기 전에 PROTO_HELLO
+// 한 줄을 보내면 그 뒤로는 양방향 모두 [종류 1바이트][본문 길이 varint][본문]
+// 프레임으로 주고받는다. 본문은 텍스트 프로토콜과 같은 UTF-8 문자열이다.
+//
+// 서버는 협상을 받으면 FR_HELLO 프레임부터 보낸다. FR_HELLO의 종류 값이 0이고
+// 텍스트 메시지에는 0 바이트가 없으므로, 클라이언트는 협상 전에 텍스트로 온
+// 안내문을 첫 0 바이트까지 버리면 프레임 경계에 맞춰진다.
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROTO_HELLO "!frame 1"  // 협상 요청 (텍스트 한 줄)
+#define PROTO_NAME "ANAG1"      // FR_HELLO 본문
+#define FRAME_HDR_MAX 6         // 종류 1바이트 + 길이 varint 최대 5바이트
+
+// 프레임 종류. 클라이언트는 FR_LINE만 보내고 나머지는 서버가 보낸다.
+// 모르는 종류는 건너뛰면 된다.
+enum frame_type {
+    FR_HELLO = 0,   // 협상 수락
+    FR_LINE,        // 클라이언트 → 서버: 명령이나 채팅 한 줄 (줄바꿈 없이)
+    FR_NOTICE,      // 일반 안내
+    FR_PROMPT,      // 닉네임 입력 요청
+    FR_ERROR,       // 명령 오류
+    FR_CHAT,        // 채팅
+    FR_SHOUT,       // 전체 방 공지 (!shout)
+    FR_ENTER,       // 방 입장
+    FR_LEAVE,       // 방 퇴장
+    FR_QUIZ,        // 퀴즈 출제
+    FR_CORRECT,     // 정답
+    FR_WRONG,       // 오답
+    FR_TIMEOUT,     // 퀴즈 제한 시간 초과
+    FR_BOARD,       // 점수판, 순위
+    FR_TYPES
+};
+
+// 프레임 헤더를 hdr에 쓰고 길이를 반환한다 (hdr는 FRAME_HDR_MAX 바이트 이상).
+static inline int frame_header(uint8_t* hdr, uint8_t type, uint32_t len) {
+    int n = 0;
+    hdr[n++] = type;
+    do {
+        uint8_t b = len & 0x7F;
+        len >>= 7;
+        hdr[n++] = b | (len ? 0x80 : 0);
+    } while (len);
+    return n;
+}
+
+// 받은 바이트 p[0..avail)에서 프레임 헤더를 읽는다. 헤더 길이를 반환하며,
+// 아직 다 오지 않았으면 0, 잘못된 헤더면 -1.
+static inline int frame_parse(const uint8_t* p, size_t avail, uint8_t* type, uint32_t* len) {
+    if (avail < 2) return 0;
+    uint32_t v = 0;
+    for (int i = 1; i < FRAME_HDR_MAX; i++) {
+        if ((size_t)i >= avail) return 0;
+        if (i == FRAME_HDR_MAX - 1 && p[i] > 0x0F) return -1;   // 32비트를 넘는 길이
+        v |= (uint32_t)(p[i] & 0x7F) << (7 * (i - 1));
+        if (!(p[i] & 0x80)) {
+            *type = p[0];
+            *len = v;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+#endif
@@ -1,20 +1,92 @@
 // RaspberryPi server
 
+#define _GNU_SOURCE // accept4, SO_REUSEPORT
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <fcntl.h> // open, O_WRONLY
 #include <errno.h> // errno
+#include "protocol.h"
+#include "utf8.h"
+#include "wordpool.h"
+#include "i2c_lcd.h"
 
-#define MAX_CLIENT 10
+#define DEFAULT_PORT 8888
+#define DEFAULT_MAX_CLIENT 4096 // -m 옵션으로 변경 가능
+#define MAX_EVENTS 256          // epoll_wait 한 번에 받는 이벤트 수
+#define ACCEPT_BATCH 64         // 루프 한 바퀴에 accept 하는 최대 연결 수
+#define URING_ENTRIES 4096      // io_uring 제출 큐 크기 (완료 큐는 4배)
+#define URING_BUFS 1024         // 샤드마다 수신용으로 제공하는 버퍼 수 (2의 거듭제곱)
+#define URING_BUF_SIZE 2048     // 수신 버퍼 하나의 크기 (INBUF_SIZE - 프레임 최대 길이보다 작게)
+#define MAX_SHARDS 64           // 리액터 스레드 수 상한, -t 옵션
+#define DEFAULT_NICK_TIMEOUT 30 // 닉네임 입력 제한 시간(초), -n 옵션
+#define DEFAULT_IDLE_TIMEOUT 1800 // 입력이 없는 연결을 끊기까지의 시간(초), -i 옵션 (0이면 끄기)
+#define QUIZ_TIME_LIMIT 15      // 퀴즈 제한 시간(초)
+#define TIMER_TICK_MS 100       // 타이머 휠 한 칸의 길이
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define NICK_SIZE 30
 #define BUF_SIZE 1024
+#define INBUF_SIZE 4096         // 연결별 입력 링 버퍼 크기 (2의 거듭제곱)
+#define MAX_LINE_LEN (BUF_SIZE - 1) // 한 줄 명령의 최대 길이
+#define OUTQ_IOV_MAX 64         // writev 한 번에 묶는 최대 세그먼트 수
+#define OUTQ_SLOTS 256          // 연결별 송신 대기열 칸 수 (2의 거듭제곱)
+#define DEFAULT_OUTQ_HIGH (64 * 1024) // 송신 대기열 high-water mark(바이트), -w 옵션
+#define OUTQ_GRACE_MS 2000      // high-water mark를 넘긴 채 버틸 수 있는 시간
+#define RANK_TOP_N 20           // !rank 에 보여줄 상위 인원 (!rank all 은 전체)
+#define SCORE_BOARD_MAX 50      // !score 에 보여줄 최대 인원
+#define ROOM_NAME_SIZE 32
+#define DEFAULT_ROOM "lobby"      // 닉네임을 정하면 들어가는 방
+#define MAX_ROOMS 1024          // 만들 수 있는 최대 방 수
+#define ROOM_HASH_SIZE 256      // 방 이름 해시 버킷 수 (2의 거듭제곱)
+#define ROOM_LIST_MAX 50        // !rooms 에 보여줄 최대 방 수
+#define QUIZ_MAX_CHARS 50       // 퀴즈 단어 최대 글자 수
+#define QUIZ_WORD_SIZE (QUIZ_MAX_CHARS * 4 + 1) // UTF-8 한 글자는 최대 4바이트
+#define QUIZ_MAX_UNITS (QUIZ_MAX_CHARS * 3) // 한글 음절을 자모로 풀면 최대 3글자
+#define SHUFFLED_SIZE (QUIZ_WORD_SIZE * 3) // 자모로 풀면 3바이트 음절이 최대 9바이트
+#define HIST_SLOTS 256          // 글자 히스토그램 칸 수 (2의 거듭제곱, QUIZ_MAX_UNITS보다 크게)
+#define ALT_ANSWERS_SHOWN 5     // 제한 시간 초과 때 보여줄 다른 정답 수
+#define AUTO_QUIZ_DELAY_MS 3000 // 자동 출제: 퀴즈가 끝나고 다음 문제까지
+#define AUTO_PICK_TRIES 64      // 자동 출제: 최근에 낸 단어를 건너뛰는 최대 횟수
+#define DEFAULT_HISTORY_PATH "quiz_history.dat" // 출제 기록 파일, -H 옵션 ("-"이면 저장 안 함)
+#define DEFAULT_SCORE_PATH "scores" // 점수 저장소 (scores.log, scores.snap), -S 옵션 ("-"이면 저장 안 함)
+#define SCORE_COMMIT_MS 20      // 점수 로그를 모아서 한 번에 쓰는 간격
+#define SCORE_COMPACT_MIN 65536 // 로그 레코드가 이보다 많고 키 수의 2배를 넘으면 스냅숏으로 합친다
 #define LCD_DEVICE_PATH "/dev/i2c_lcd_display" // LCD 장치 파일 경로
+#define LCD_MSG_LEN (LCD_ROWS * (LCD_COLS + 1) + 1)  // 16칸 두 줄 + '\n' + NUL
+#define STAT_SUB_BITS 5         // 통계 히스토그램: 2의 거듭제곱 구간마다 32칸 (상대 오차 약 3%)
+#define STAT_SUB (1 << STAT_SUB_BITS)
+#define STAT_SLOTS (64 * STAT_SUB)
+#define ADMIN_READ_MS 200       // 관리 소켓에서 요청 줄을 기다리는 시간
 
 // 색상 매크로
 #define RESET   "\033[0m"
@@ -27,390 +99,4144 @@
 #define LINE1 0x80
 #define LINE2 0xC0
 
-int client_socks[MAX_CLIENT];
-char client_names[MAX_CLIENT][30];
-int scores[MAX_CLIENT];
-int num_clients = 0;
+#define container_of(ptr, type, member) ((type*)((char*)(ptr) - offsetof(type, member)))
+
+// epoll에 등록되는 핸들 종류
+enum handle_kind {
+    H_LISTENER,
+    H_CLIENT,
+    H_TIMER,
+    H_MAILBOX,
+};
+
+// 타이머 휠에 거는 타이머. 보통 다른 구조체에 넣어 두고
+// 콜백에서 container_of로 꺼내 쓴다.
+struct timer {
+    struct timer* prev;
+    struct timer* next;
+    struct timer** slot;        // 걸려 있는 칸, 없으면 NULL
+    unsigned long long expires; // 만료 틱
+    void (*fn)(struct timer*);
+};
+
+struct timer_wheel {
+    struct timer* slots[WHEEL_LEVELS][WHEEL_SIZE];
+    unsigned long long now;     // 다음에 처리할 틱
+    int count;
+    int armed;
+};
+
+// 연결 상태: 닉네임 대기 → 게임 참여 → 종료 처리 중
+// MIGRATING은 다른 샤드의 방으로 넘어가는 중이라 입력을 처리하지 않는다.
+enum conn_state {
+    AWAITING_NICK,
+    ACTIVE,
+    MIGRATING,
+    CLOSING,
+};
+
+// 연결별 입력 링 버퍼. head/tail/scan은 계속 증가하는 위치값이며
+// INBUF_SIZE로 나눈 나머지가 실제 인덱스다.
+struct inbuf {
+    char data[INBUF_SIZE];
+    unsigned head;      // 아직 처리하지 않은 줄의 시작
+    unsigned scan;      // 줄바꿈 검색을 이어갈 위치
+    unsigned tail;      // 받은 데이터의 끝
+    int discarding;     // 너무 긴 줄을 버리는 중
+};
+
+// 한 번 만들어 모든 수신자가 공유하는 송신 메시지. 내용은 만든 뒤 바뀌지
+// 않으며, 마지막 수신자가 다 보내고 참조를 놓으면 해제된다.
+// 본문 바로 앞에 프레임 헤더를 미리 붙여 두어, 텍스트 연결은 본문만, 프레임
+// 연결은 헤더부터 보내면 되므로 같은 메시지를 복사 없이 함께 쓴다.
+struct msg {
+    int refcnt;
+    size_t len;                 // 본문 길이
+    uint8_t hdr_len;            // 프레임 헤더 길이 (hdr의 뒤쪽 hdr_len 바이트)
+    char hdr[FRAME_HDR_MAX];
+    char data[];
+};
+
+_Static_assert(offsetof(struct msg, data) == offsetof(struct msg, hdr) + FRAME_HDR_MAX,
+    "프레임 헤더는 본문 바로 앞에 있어야 한다");
+
+// 연결별 송신 대기열. 메시지 참조만 담는 고정 크기 링이며
+// 소켓이 쓰기 가능해지면 writev로 한꺼번에 비운다.
+struct outq {
+    struct msg* slot[OUTQ_SLOTS];
+    unsigned head;
+    unsigned tail;
+    size_t head_off;        // head 메시지에서 이미 보낸 바이트 수
+    size_t bytes;           // 대기 중인 총 바이트 수
+    unsigned inflight;      // io_uring이 보내는 중인 메시지 수 (head부터)
+    long long over_since;   // high-water mark를 넘긴 시각(ms), 아니면 0
+};
+
+// 길이를 미리 알 수 없는 응답 문자열용 가변 버퍼
+struct strbuf {
+    char* data;
+    size_t len;
+    size_t cap;
+};
+
+// high-water mark를 계속 넘는 클라이언트 처리 방식
+enum outq_policy {
+    OUTQ_DROP,      // 연결을 끊는다
+    OUTQ_SQUASH,    // 밀린 메시지를 버리고 안내문 하나로 대체한다
+};
+
+// 연결별 상태 객체. 세션 테이블(slab)의 고정 위치에 있으며 fd_table로 찾는다.
+struct conn {
+    enum handle_kind kind;
+    int fd;
+    int slot;                       // conn_slab 내 위치
+    enum conn_state state;
+    char nick[NICK_SIZE];
+    int score;                      // 지금 방에서의 점수
+    struct room* room;              // ACTIVE일 때 들어가 있는 방 (MIGRATING이면 갈 방)
+    struct conn* prev;              // 같은 방 참가자 목록 (입장 순)
+    struct conn* next;
+    struct conn* lb_prev;           // 같은 점수 버킷 (먼저 도달한 순)
+    struct conn* lb_next;
+    struct timer timer;             // 닉네임 입력 제한 / 유휴 연결 정리
+    long long last_active;          // 마지막으로 입력을 받은 시각(ms)
+    struct conn* close_next;        // 루프 끝에서 해제할 연결 목록
+    struct inbuf in;
+    struct outq out;
+    int dead;                       // 송신 실패/정책으로 끊을 예정
+    int framed;                     // 프레임 프로토콜로 협상함
+    struct conn* dead_next;
+    struct conn* move_next;         // 루프 끝에서 다른 샤드로 넘길 연결 목록
+    // io_uring 백엔드 전용
+    int recv_armed;                 // 멀티샷 recv가 걸려 있음
+    int detaching;                  // 다른 샤드로 넘기려고 걸린 작업이 끝나길 기다림
+    int flush_queued;               // send_list에 올라 있음
+    int send_framed;                // 보내는 중인 sendmsg를 만들 때의 framed
+    struct conn* send_next;         // 루프 끝에서 sendmsg를 제출할 연결 목록
+    struct msghdr send_msg;         // 보내는 중인 sendmsg. 완료될 때까지 유지한다.
+    struct iovec send_iov[OUTQ_IOV_MAX];
+};
+
+// 점수별 버킷 하나
+struct score_bucket {
+    struct conn* head;
+    struct conn* tail;
+    int count;
+};
+
+// 점진적으로 갱신되는 순위표. version은 점수/인원이 바뀔 때마다 증가하며
+// 캐시된 순위표 메시지는 version이 같을 동안 재사용된다.
+struct leaderboard {
+    struct score_bucket* buckets;   // buckets[점수]
+    int* tree;                      // 버킷 인원수의 펜윅 트리 (1-based)
+    int cap;
+    int max_score;
+    int players;
+    unsigned version;
+    struct msg* top_cache;          // !rank
+    unsigned top_ver;
+    struct msg* full_cache;         // !rank all
+    unsigned full_ver;
+    struct msg* score_cache;        // !score
+    unsigned score_ver;
+};
+
+// 출제 단어 집합의 한 칸. len이 0이면 빈 칸이다.
+struct word_entry {
+    uint64_t hash;
+    uint32_t off;       // 아레나 내 위치
+    uint32_t used_at;   // 마지막 출제 시각 (unix time)
+    uint8_t len;
+};
+
+struct word_set {
+    struct word_entry* slots;
+    size_t cap;         // 2의 거듭제곱
+    size_t count;
+    char* arena;        // 단어 문자열을 이어 붙인 버퍼
+    size_t arena_len;
+    size_t arena_cap;
+};
+
+// 점수 표의 한 칸. len이 0이면 빈 칸이다.
+struct score_entry {
+    uint64_t hash;
+    uint32_t off;       // 아레나 내 키 위치
+    int32_t score;
+    uint8_t len;
+};
+
+struct score_table {
+    struct score_entry* slots;
+    size_t cap;         // 2의 거듭제곱
+    size_t count;
+    char* arena;        // 키 문자열을 이어 붙인 버퍼
+    size_t arena_len;
+    size_t arena_cap;
+};
+
+// 점수 저장소. live와 대기 버퍼는 lock으로 보호하고, durable과 로그 파일은
+// 기록 스레드만 만진다.
+struct score_store {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct score_table live;        // 지금 점수 (이벤트 루프가 읽고 쓴다)
+    char* pending;                  // 아직 로그에 쓰지 않은 레코드
+    size_t pending_len;
+    size_t pending_cap;
+    int enabled;                    // 로그에 쓰는 중
+    struct score_table durable;     // 로그에 쓴 데까지의 점수 (스냅숏 원본)
+    int log_fd;
+    uint64_t epoch;                 // 지금 로그의 세대
+    size_t log_records;
+    const char* log_path;
+    const char* snap_path;
+};
+
+// 단어 풀의 난이도 하나에서 단어를 뽑는 순서 (pool_next 참고)
+struct pool_cursor {
+    uint32_t start;
+    uint32_t stride;
+    uint32_t step;
+};
+
+// 정답의 글자 히스토그램. 서로 다른 글자마다 오픈 어드레싱 칸을 하나씩 잡고
+// 그 칸 번호로 개수를 센다. 추측 단어도 같은 칸 번호로 세면 두 개수 배열을
+// memcmp 한 번으로 (벡터 단위로) 비교할 수 있다.
+struct letter_hist {
+    uint32_t key[HIST_SLOTS];   // 글자(코드 포인트) + 1, 0이면 빈 칸
+    uint8_t count[HIST_SLOTS];
+    int units;                  // 전체 글자 수
+};
+
+// 방 하나. 퀴즈 진행 상태, 출제 기록, 순위표, 참가자 목록을 따로 가진다.
+// 방은 shard의 스레드만 건드린다. 다른 스레드는 num_members와 quiz_active만
+// (원자적으로) 읽는다.
+struct room {
+    char name[ROOM_NAME_SIZE];
+    struct shard* shard;            // 이 방을 맡은 샤드
+    struct room* hash_next;
+    int refs;                       // 참가자 + 들어오는 중인 연결 (rooms_lock으로 보호)
+    struct conn* members_head;      // 참가자 목록 (입장 순)
+    struct conn* members_tail;
+    int num_members;
+    struct leaderboard lb;
+    char current_answer[QUIZ_WORD_SIZE];
+    char answer_key[QUIZ_WORD_SIZE]; // 정규화한 정답
+    size_t answer_len;
+    uint64_t answer_sig;            // 정답의 글자 구성 서명
+    int answer_chars;               // 정답 글자 수
+    int answer_jamo;                // 한글을 자모로 풀어 낸 문제
+    struct letter_hist answer_hist;
+    int quiz_active;
+    struct timer quiz_timer;
+    struct word_set history;        // 이 방의 출제 기록
+    int auto_on;                    // 자동 출제 중
+    int auto_tier;                  // 자동 출제 난이도
+    struct timer auto_timer;        // 다음 자동 출제
+    struct pool_cursor cursor[WP_TIERS];
+};
+
+// 사전 단어 하나. len이 0이면 빈 칸이다.
+struct dict_word {
+    uint64_t hash;
+    uint64_t sig;       // 글자 구성 서명
+    uint32_t off;       // text 내 위치 ('\0'으로 끝남)
+    uint32_t sig_next;  // 같은 서명의 다음 단어 (칸 번호 + 1, 0이면 끝)
+    uint8_t len;
+};
+
+// 글자 구성이 같은 단어 묶음. count가 0이면 빈 칸이다.
+struct sig_group {
+    uint64_t sig;
+    uint32_t first;     // 첫 단어 (칸 번호 + 1)
+    uint32_t count;
+};
+
+struct anagram_index {
+    char* text;                 // 사전 파일 내용 (단어 문자열 저장소)
+    struct dict_word* words;    // 단어 해시로 찾는 표
+    size_t cap;
+    size_t count;
+    struct sig_group* groups;   // 서명으로 찾는 표
+    size_t group_cap;
+    size_t group_count;
+};
+
+// mmap 한 단어 풀 파일. 시작할 때 열고 나면 읽기만 한다.
+struct word_pool {
+    const struct wordpool_header* hdr;  // NULL이면 단어 풀 없음
+    const struct wordpool_entry* entries;
+    const char* text;
+};
+
+// 샤드 우편함에 넣는 일감
+enum mail_kind {
+    MAIL_ADOPT,     // c를 넘겨받아 c->room에 넣는다
+    MAIL_ANNOUNCE,  // 이 샤드의 모든 방에 m을 보낸다
+    MAIL_ROOM_PUT,  // 다른 샤드에서 놓은 r의 참조를 대신 놓는다
+};
+
+struct mail {
+    struct mail* next;
+    enum mail_kind kind;
+    struct conn* c;
+    struct msg* m;
+    struct room* r;
+};
+
+// 생산자 여럿, 소비자 하나인 잠금 없는 큐 (Vyukov 방식). 생산자는 head를
+// 교환하고, 소비자는 tail에서 꺼낸다. stub은 큐가 비었을 때 자리를 지킨다.
+struct mailbox {
+    struct mail* head;
+    struct mail* tail;
+    struct mail stub;
+    int pending;            // eventfd를 이미 깨웠으면 1
+};
+
+// 샤드 하나의 io_uring. 제출/완료 큐와 수신용 제공 버퍼 링을 mmap 해 두고
+// 시스템 콜은 io_uring_enter 한 번으로 제출과 대기를 같이 한다.
+struct uring {
+    int fd;
+    unsigned* sq_khead;
+    unsigned* sq_ktail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_tail;               // 채웠지만 아직 커널에 알리지 않은 꼬리 포함
+    struct io_uring_sqe* sqes;
+    unsigned* cq_khead;
+    unsigned* cq_ktail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;                   // sq_map과 같으면 따로 풀지 않는다
+    size_t cq_map_len;
+    size_t sqes_len;
+    struct io_uring_buf_ring* br;   // 제공 버퍼 링
+    unsigned br_entries;
+    unsigned short br_tail;
+    char* bufs;
+};
+
+// 값 분포를 세는 HDR 방식 히스토그램. 2의 거듭제곱 구간마다 STAT_SUB칸으로
+// 나눠 나노초부터 초 단위까지 같은 상대 오차로 분위수를 구한다.
+struct stat_hist {
+    uint64_t count[STAT_SLOTS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+// 처리 시간을 따로 재는 명령 종류
+enum stat_cmd {
+    CMD_QUIZ,
+    CMD_RANK,
+    CMD_SCORE,
+    CMD_GUESS,      // 퀴즈 중의 정답 시도
+    CMD_CHAT,
+    CMD_OTHER,      // !join, !rooms 등 나머지 명령
+    CMD_KINDS
+};
 
-char current_answer[100] = "";
-int quiz_active = 0;
-time_t quiz_start_time = 0;
+// 누적 카운터. 합산할 때 uint64_t 배열로 훑으므로 다른 타입을 넣지 않는다.
+struct stat_counters {
+    uint64_t loops;             // 이벤트 루프를 돈 횟수
+    uint64_t events;            // 처리한 epoll 이벤트 / io_uring 완료 수
+    uint64_t accepts;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t broadcasts;
+    uint64_t fanout_bytes;      // 브로드캐스트로 대기열에 넣은 바이트 (본문 × 수신자)
+    uint64_t squashed;          // 송신 대기열이 밀려 버린 메시지 수
+    uint64_t dropped;           // 송신 대기열이 밀려 끊은 연결 수
+    uint64_t lcd_errors;
+};
 
-char quiz_history[100][100];
-int quiz_history_count = 0;
+// 샤드별 통계. 자기 샤드 스레드만 쓰므로 잠금이나 원자적 덧셈 없이 값을
+// 늘리고, 읽는 쪽(!stats, 관리 소켓)은 모든 샤드의 값을 relaxed로 읽어 더한다.
+struct shard_stats {
+    struct stat_counters n;
+    struct stat_hist loop_ns;   // 루프 한 바퀴의 처리 시간 (이벤트 대기 제외)
+    struct stat_hist cmd_ns[CMD_KINDS];
+    struct stat_hist fanout;    // 브로드캐스트 한 번의 수신자 수
+    struct stat_hist outq;      // 메시지를 넣은 직후 송신 대기열의 바이트 수
+    struct stat_hist lcd_ns;    // send_to_lcd의 write/FLUSH 시간
+};
 
-int lcd_fd = -1;
+// 자기 샤드의 카운터를 늘린다. 쓰는 스레드가 하나뿐이라 읽고 더한 값을
+// 그냥 저장하면 되고, 다른 스레드가 읽는 값이 찢어지지 않게 원자적으로 쓴다.
+static inline void stat_add(uint64_t* p, uint64_t v) {
+    __atomic_store_n(p, *p + v, __ATOMIC_RELAXED);
+}
+
+// 리액터 스레드 하나
+struct shard {
+    pthread_t thread;
+    int epfd;
+    struct uring ring;      // use_uring일 때 epfd 대신 쓴다
+    struct conn listener;
+    struct conn timer_handle;
+    struct conn mail_handle;
+    int accept_pending;     // 배치 한도 때문에 accept를 멈춘 경우 1
+    struct timer_wheel wheel;
+    struct mailbox mail;
+    struct conn* close_list;
+    struct conn* dead_list;
+    struct conn* move_list;
+    struct conn* send_list;
+    struct shard_stats stats;
+};
+
+int max_clients = DEFAULT_MAX_CLIENT;
+
+// 세션 테이블: 연결 객체를 담는 slab과 빈 칸 스택, fd → 연결 조회표.
+// 입장/퇴장 시 다른 참가자의 데이터는 움직이지 않는다. 빈 칸 스택은 샤드가
+// 함께 쓰므로 slab_lock으로 보호한다. fd_table의 각 칸은 그 fd를 가진
+// 샤드만 읽고 쓴다.
+struct conn* conn_slab;
+int* free_slots;
+int free_top = 0;
+pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+struct conn** fd_table;
+int fd_table_size = 0;
+
+int num_clients = 0;  // 모든 방의 ACTIVE 참가자 수 (원자적으로 갱신)
+int num_conns = 0;    // 닉네임 대기 중인 연결 포함 (원자적으로 갱신)
+
+// 방 테이블: 이름 해시로 찾고, rooms는 만든 순서대로 !rooms 목록에 쓴다.
+// 참가자도, 들어오는 중인 연결도, 진행 중인 퀴즈도 없는 방은 없앤다. 그래서
+// !join으로 방을 잔뜩 만들어도 빈 방이 자리를 차지하지 않는다. 방 만들기/찾기/
+// 없애기와 rooms[] 훑기는 rooms_lock으로 보호하고, num_rooms는 통계용으로
+// 원자적으로도 읽는다.
+//
+// 없앤 방의 출제 기록은 history_idle에 "방이름\t단어"로 옮겨 두었다가 같은
+// 이름의 방을 다시 만들 때 되살린다. 시작할 때 읽은 로비 밖의 기록도 방을
+// 만들지 않고 여기에 둔다. history_idle도 rooms_lock으로 보호한다.
+struct room* room_hash[ROOM_HASH_SIZE];
+struct room* rooms[MAX_ROOMS];
+int num_rooms = 0;
+struct room* lobby = NULL;      // 서버가 참조를 하나 쥐고 있어 없어지지 않는다
+struct word_set history_idle;
+pthread_mutex_t rooms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int reuse_window = 0;       // 같은 단어를 다시 낼 수 있기까지의 시간(초), 0이면 영구 금지 (-r)
+int history_fd = -1;
+size_t history_records = 0;
+
+struct score_store scores = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .log_fd = -1,
+};
+
+struct anagram_index dict;  // -d 옵션으로 읽은 사전, 없으면 비어 있다
+struct word_pool pool;      // -W 옵션으로 연 자동 출제 단어 풀
+const char* tier_names[WP_TIERS] = { "쉬움", "보통", "어려움" };
+const char* tier_keys[WP_TIERS] = { "easy", "normal", "hard" };
+
+// LCD 우선순위마다 따로 연 fd. 드라이버는 우선순위를 fd마다 기억하므로
+// 여러 샤드가 동시에 써도 ioctl과 write 사이에 섞이지 않는다.
+int lcd_fds[LCD_PRIO_LEVELS] = { -1, -1, -1 };
+// 드라이버의 셀 버퍼를 매핑한 것. 예전 드라이버라 mmap이 안 되면 NULL이고
+// write()로 보낸다. 여러 샤드가 셀을 고치고 FLUSH하는 사이에 섞이지 않게 잠근다.
+char (*lcd_cells)[LCD_COLS] = NULL;
+pthread_mutex_t lcd_lock = PTHREAD_MUTEX_INITIALIZER;
+int nick_timeout_ms = DEFAULT_NICK_TIMEOUT * 1000;
+int idle_timeout_ms = DEFAULT_IDLE_TIMEOUT * 1000;
+
+struct shard* shards = NULL;
+int num_shards = 1;
+__thread struct shard* this_shard;  // 현재 스레드가 맡은 샤드
+
+long long start_ms;          // 서버를 시작한 시각, !stats 가동 시간
+int use_uring = 0;           // -b uring, 시작할 때 못 쓰면 epoll로 돌아간다
+size_t outq_high = DEFAULT_OUTQ_HIGH;
+enum outq_policy outq_policy = OUTQ_SQUASH;
+
+int word_units(const char* w, size_t len, int jamo, uint32_t* out, int max);
+void hist_build(struct letter_hist* h, const uint32_t* units, int n);
+int hist_match(const struct letter_hist* h, const uint32_t* units, int n);
+void shuffle(const char* word, int jamo, char* shuffled);
+uint64_t hash_bytes(const char* s, size_t len);
+size_t normalize_word(const char* in, char* out, size_t out_size);
+int word_set_recent(struct word_set* ws, const char* w, size_t len, time_t now, int window);
+int word_set_put(struct word_set* ws, const char* w, size_t len, time_t used_at);
+void history_append(struct room* r, const char* w, size_t len, time_t used_at);
+void history_load(const char* path);
+int score_load(struct room* r, const char* nick);
+void score_record(struct room* r, const char* nick, int delta);
+void score_open(const char* path);
+int dict_contains(const char* w, size_t len);
+int dict_anagrams(const char* w, size_t len, uint64_t sig, const char** out, int max);
+void dict_load(const char* path);
+int answer_accepted(struct room* r, const char* guess);
+void pool_open(const char* path);
+const struct wordpool_entry* pool_next(struct pool_cursor* cur, int tier);
+void auto_quiz(struct timer* t);
+void quiz_start(struct room* r, const char* word, const char* key, size_t key_len, uint64_t sig, int jamo, struct conn* setter);
+void quiz_end(struct room* r);
+struct msg* msg_new(const char* data, size_t len);
+struct msg* msg_tag(struct msg* m, uint8_t type);
+struct msg* msg_copy(const struct msg* m);
+struct msg* msg_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+struct msg* msg_ref(struct msg* m);
+void msg_unref(struct msg* m);
+struct conn* conn_by_fd(int fd);
+struct conn* conn_alloc(int fd);
+void broadcast(struct room* r, struct conn* sender, struct msg* m);
+void conn_send(struct conn* c, struct msg* m);
+void send_str(struct conn* c, const char* str);
+void send_typed(struct conn* c, uint8_t type, const char* str);
+int sb_printf(struct strbuf* sb, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+struct msg* sb_to_msg(struct strbuf* sb);
+void lb_add(struct leaderboard* lb, struct conn* c);
+void lb_remove(struct leaderboard* lb, struct conn* c);
+void lb_add_score(struct leaderboard* lb, struct conn* c, int delta);
+int lb_rank_of(struct leaderboard* lb, struct conn* c);
+struct conn* lb_next(struct leaderboard* lb, struct conn* prev);
+struct msg* lb_rank_board(struct leaderboard* lb, int full);
+struct msg* lb_score_board(struct leaderboard* lb, struct conn* members);
+int room_name_valid(const char* name);
+struct room* room_find(const char* name, size_t len);
+struct room* room_get(const char* name, size_t len);
+void room_hold(struct room* r);
+void room_put(struct room* r);
+void room_enter(struct room* r, struct conn* c);
+void room_leave(struct conn* c, const char* how);
+struct msg* room_list(struct room* cur);
+int conn_flush(struct conn* c);
+void mark_dead(struct conn* c);
+void close_dead(void);
+void send_to_lcd(const char* msg, enum lcd_prio prio);
+void lcd_open_all(void);
+long long now_ms(void);
+long long now_ns(void);
+void stat_hist_add(struct stat_hist* h, uint64_t v);
+void stats_format(struct strbuf* sb, int prom);
+void admin_open(const char* path);
+int set_nonblocking(int fd);
+void accept_clients(void);
+int conn_watch(struct conn* c);
+void uring_recv(struct conn* c);
+int uring_detach(struct conn* c);
+void read_client(struct conn* c);
+void process_input(struct conn* c);
+void dispatch_line(struct conn* c, char* line);
+void start_framing(struct conn* c);
+void set_nick(struct conn* c, const char* line);
+void activate_client(struct conn* c);
+enum stat_cmd handle_message(struct conn* c, char* buf);
+void close_conn(struct conn* c);
+void close_conn_fd(struct conn* c);
+void timer_add(struct timer* t, long long ms, void (*fn)(struct timer*));
+void timer_del(struct timer* t);
+void timer_run(void);
+void drain_timerfd(void);
+void conn_timeout(struct timer* t);
+void quiz_timeout(struct timer* t);
+void reap_closed(void);
+void shard_post(struct shard* s, enum mail_kind kind, struct conn* c, struct msg* m);
+void shard_post_room(struct shard* s, struct room* r);
+static void shard_deliver(struct shard* s, struct mail* mail);
+void announce_all(struct msg* m);
+void drain_mailbox(void);
+void conn_join(struct conn* c, struct room* r);
+void flush_moves(void);
+void* shard_main(void* arg);
+
+// --- 글자 단위 처리 ---
+// 퀴즈 단어는 UTF-8이라 바이트가 아닌 글자(코드 포인트) 단위로 다룬다.
+// 단어는 한 번만 풀어서 스택 배열에 담고, 섞기와 정답 비교는 그 배열로 한다.
+
+// 단어를 글자로 풀어 out에 담고 글자 수를 반환한다. jamo이면 한글 음절을
+// 자모로 나눈다. 올바른 UTF-8이 아니거나 max를 넘으면 -1.
+int word_units(const char* w, size_t len, int jamo, uint32_t* out, int max) {
+    const char* end = w + len;
+    int n = 0;
+    while (w < end) {
+        uint32_t cp = utf8_next(&w, end);
+        if (cp == UTF8_INVALID) return -1;
+        if (jamo && is_hangul_syllable(cp)) {
+            uint32_t parts[3];
+            int k = hangul_split(cp, parts);
+            if (n + k > max) return -1;
+            for (int i = 0; i < k; i++) out[n++] = parts[i];
+        }
+        else {
+            if (n == max) return -1;
+            out[n++] = cp;
+        }
+    }
+    return n;
+}
+
+static int hist_slot(const struct letter_hist* h, uint32_t cp) {
+    uint32_t i = (cp * 0x9E3779B1u) >> 24;
+    while (h->key[i] != 0 && h->key[i] != cp + 1) {
+        i = (i + 1) & (HIST_SLOTS - 1);
+    }
+    return i;
+}
+
+void hist_build(struct letter_hist* h, const uint32_t* units, int n) {
+    memset(h, 0, sizeof(*h));
+    for (int i = 0; i < n; i++) {
+        int s = hist_slot(h, units[i]);
+        h->key[s] = units[i] + 1;
+        h->count[s]++;
+    }
+    h->units = n;
+}
+
+// units의 글자 구성이 h와 같은지. 정답에 없는 글자가 나오면 바로 끝낸다.
+int hist_match(const struct letter_hist* h, const uint32_t* units, int n) {
+    if (n != h->units) return 0;
+    uint8_t count[HIST_SLOTS];
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < n; i++) {
+        int s = hist_slot(h, units[i]);
+        if (h->key[s] == 0 || ++count[s] > h->count[s]) return 0;
+    }
+    return memcmp(count, h->count, sizeof(count)) == 0;
+}
 
-void shuffle(const char* str, char* shuffled);
-int get_client_index(int sock);
-void broadcast(int sender, const char* msg);
-void send_to_lcd(const char* msg);
+// 앞 글자에 붙어 한 글자로 보이는 코드 포인트인지 (결합 문자, 이체 선택자,
+// 피부색 수식자, ZWJ 연결, 첫가끝 한글의 중성·종성). 간단히 범위로만 본다.
+static int joins_previous(uint32_t cp, uint32_t prev) {
+    return (cp >= 0x0300 && cp <= 0x036F) || (cp >= 0x1AB0 && cp <= 0x1AFF)
+        || (cp >= 0x1DC0 && cp <= 0x1DFF) || (cp >= 0x20D0 && cp <= 0x20FF)
+        || (cp >= 0xFE00 && cp <= 0xFE0F) || (cp >= 0xFE20 && cp <= 0xFE2F)
+        || (cp >= 0x1F3FB && cp <= 0x1F3FF) || cp == 0x200D || prev == 0x200D
+        || (cp >= 0x1160 && cp <= 0x11FF && prev >= 0x1100 && prev <= 0x11FF);
+}
+
+// 단어를 글자 덩어리 단위로 섞는다. 덩어리마다 UTF-8 바이트를 그대로 옮기므로
+// 섞은 결과도 올바른 UTF-8이다. jamo이면 한글 음절을 자모로 풀어 자모를 섞는다.
+// shuffled는 SHUFFLED_SIZE 바이트 이상이어야 한다.
+void shuffle(const char* word, int jamo, char* shuffled) {
+    char buf[SHUFFLED_SIZE];
+    uint16_t start[QUIZ_MAX_UNITS + 1];
+    int order[QUIZ_MAX_UNITS];
+    const char* p = word;
+    const char* end = word + strlen(word);
+    size_t used = 0;
+    uint32_t prev = 0;
+    int n = 0;
+
+    while (p < end) {
+        const char* s = p;
+        uint32_t cp = utf8_next(&p, end);
+        if (jamo && is_hangul_syllable(cp)) {
+            uint32_t parts[3];
+            int k = hangul_split(cp, parts);
+            if (n + k > QUIZ_MAX_UNITS) break;
+            for (int i = 0; i < k; i++) {
+                start[n++] = used;
+                used += utf8_put(parts[i], buf + used);
+            }
+        }
+        else {
+            if (n > 0 && joins_previous(cp, prev)) {
+                if (used + (p - s) >= sizeof(buf)) break;
+            }
+            else {
+                if (n == QUIZ_MAX_UNITS || used + (p - s) >= sizeof(buf)) break;
+                start[n++] = used;
+            }
+            memcpy(buf + used, s, p - s);
+            used += p - s;
+        }
+        prev = cp;
+    }
+    start[n] = used;
 
-void shuffle(const char* str, char* shuffled) {
-    int len = strlen(str);
-    strcpy(shuffled, str);
-    for (int i = len - 1; i > 0; i--) {
+    for (int i = 0; i < n; i++) order[i] = i;
+    for (int i = n - 1; i > 0; i--) {
         int j = rand() % (i + 1);
-        char tmp = shuffled[i];
-        shuffled[i] = shuffled[j];
-        shuffled[j] = tmp;
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    char* out = shuffled;
+    for (int i = 0; i < n; i++) {
+        size_t len = start[order[i] + 1] - start[order[i]];
+        memcpy(out, buf + start[order[i]], len);
+        out += len;
     }
+    *out = '\0';
 }
 
-int get_client_index(int sock) {
-    for (int i = 0; i < num_clients; i++) {
-        if (client_socks[i] == sock) return i;
+// --- 출제 단어 기록 ---
+// 정규화한 단어를 오픈 어드레싱 해시 집합에 넣어 O(1)로 중복을 검사한다.
+// 단어 문자열은 하나의 아레나에 이어 붙여 단어마다 할당하지 않는다.
+
+uint64_t hash_bytes(const char* s, size_t len) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
     }
-    return -1;
+    return h;
+}
+
+// 앞뒤 공백을 없애고 ASCII 대문자를 소문자로 바꾼다. 결과 길이를 반환한다.
+size_t normalize_word(const char* in, char* out, size_t out_size) {
+    while (*in && isspace((unsigned char)*in)) in++;
+    size_t len = strlen(in);
+    while (len > 0 && isspace((unsigned char)in[len - 1])) len--;
+    if (len >= out_size) len = out_size - 1;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = tolower((unsigned char)in[i]);
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static struct word_entry* word_set_slot(struct word_set* ws, const char* w, size_t len, uint64_t h) {
+    size_t mask = ws->cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        struct word_entry* e = &ws->slots[i];
+        if (e->len == 0) return e;
+        if (e->hash == h && e->len == len && memcmp(ws->arena + e->off, w, len) == 0) return e;
+    }
+}
+
+static int word_set_grow(struct word_set* ws) {
+    size_t cap = ws->cap ? ws->cap * 2 : 1024;
+    struct word_entry* old = ws->slots;
+    size_t old_cap = ws->cap;
+
+    ws->slots = calloc(cap, sizeof(*ws->slots));
+    if (ws->slots == NULL) {
+        ws->slots = old;
+        return -1;
+    }
+    ws->cap = cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].len == 0) continue;
+        *word_set_slot(ws, ws->arena + old[i].off, old[i].len, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
 }
 
-void broadcast(int sender, const char* msg) {
-    for (int i = 0; i < num_clients; i++) {
-        if (client_socks[i] != sender) {
-            write(client_socks[i], msg, strlen(msg));
+// 단어가 window초 안에 쓰였는지 본다 (window가 0이면 기간 제한 없음).
+int word_set_recent(struct word_set* ws, const char* w, size_t len, time_t now, int window) {
+    if (ws->count == 0) return 0;
+    struct word_entry* e = word_set_slot(ws, w, len, hash_bytes(w, len));
+    if (e->len == 0) return 0;
+    return window == 0 || now - (time_t)e->used_at < window;
+}
+
+// 단어를 넣거나 사용 시각을 갱신한다.
+int word_set_put(struct word_set* ws, const char* w, size_t len, time_t used_at) {
+    if (len == 0 || len > 255) return -1;
+    if ((ws->count + 1) * 4 > ws->cap * 3 && word_set_grow(ws) == -1) return -1;
+
+    uint64_t h = hash_bytes(w, len);
+    struct word_entry* e = word_set_slot(ws, w, len, h);
+    if (e->len == 0) {
+        if (ws->arena_len + len > ws->arena_cap) {
+            size_t cap = ws->arena_cap ? ws->arena_cap * 2 : 16384;
+            while (cap < ws->arena_len + len) cap *= 2;
+            char* arena = realloc(ws->arena, cap);
+            if (arena == NULL) return -1;
+            ws->arena = arena;
+            ws->arena_cap = cap;
         }
+        memcpy(ws->arena + ws->arena_len, w, len);
+        e->hash = h;
+        e->off = ws->arena_len;
+        e->len = len;
+        ws->arena_len += len;
+        ws->count++;
     }
+    e->used_at = (uint32_t)used_at;
+    return 0;
 }
 
-void send_to_lcd(const char* msg) {
-    if (lcd_fd == -1) {
-        fprintf(stderr, "LCD 장치가 열려 있지 않습니다. 메시지: '%s'\n", msg);
+// 기록 파일 레코드: [길이 1바이트][사용 시각 4바이트 LE][방이름\t단어]. 같은
+// 단어가 여러 번 나오면 마지막 레코드가 이긴다. 방 이름이 없는 예전 레코드는
+// 기본 방의 기록으로 읽는다.
+static void put_le32(unsigned char* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 이미 "방이름\t단어"로 된 레코드 본문을 쓴다.
+static void history_write(const char* text, size_t len, time_t used_at) {
+    if (history_fd == -1 || len > 255) return;
+    unsigned char rec[5 + 255];
+    rec[0] = len;
+    put_le32(rec + 1, (uint32_t)used_at);
+    memcpy(rec + 5, text, len);
+    if (write(history_fd, rec, 5 + rec[0]) == -1) perror("출제 기록 저장 실패");
+    __atomic_fetch_add(&history_records, 1, __ATOMIC_RELAXED);
+}
+
+void history_append(struct room* r, const char* w, size_t len, time_t used_at) {
+    size_t name_len = strlen(r->name);
+    if (name_len + 1 + len > 255) return;
+    char text[255];
+    memcpy(text, r->name, name_len);
+    text[name_len] = '\t';
+    memcpy(text + name_len + 1, w, len);
+    history_write(text, name_len + 1 + len, used_at);
+}
+
+// 기록 파일을 읽어 방마다 집합을 복원한다. 중복 레코드가 많이 쌓였으면
+// 현재 집합만 남기도록 파일을 다시 쓴다.
+void history_load(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+        struct stat st;
+        unsigned char* data = NULL;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) data = malloc(st.st_size);
+        size_t got = 0;
+        while (data && got < (size_t)st.st_size) {
+            ssize_t n = read(fd, data + got, st.st_size - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        close(fd);
+
+        size_t pos = 0;
+        while (pos + 5 <= got && pos + 5 + data[pos] <= got) {
+            size_t len = data[pos];
+            char* w = (char*)data + pos + 5;
+            char* tab = memchr(w, '\t', len);
+            uint32_t used_at = get_le32(data + pos + 1);
+            // 로비 밖의 기록은 방을 만들지 않고 쉬는 기록으로 둔다.
+            if (tab && !((size_t)(tab - w) == strlen(DEFAULT_ROOM) && memcmp(w, DEFAULT_ROOM, tab - w) == 0)) {
+                word_set_put(&history_idle, w, len, used_at);
+            }
+            else {
+                if (tab) {
+                    len -= tab + 1 - w;
+                    w = tab + 1;
+                }
+                word_set_put(&lobby->history, w, len, used_at);
+            }
+            pos += 5 + data[pos];
+            history_records++;
+        }
+        free(data);
+    }
+
+    size_t words = lobby->history.count + history_idle.count;
+
+    if (history_records > words * 2 + 1024) {
+        char tmp[512];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        history_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (history_fd != -1) {
+            history_records = 0;
+            struct word_set* ws = &lobby->history;
+            for (size_t k = 0; k < ws->cap; k++) {
+                struct word_entry* e = &ws->slots[k];
+                if (e->len) history_append(lobby, ws->arena + e->off, e->len, e->used_at);
+            }
+            ws = &history_idle;
+            for (size_t k = 0; k < ws->cap; k++) {
+                struct word_entry* e = &ws->slots[k];
+                if (e->len) history_write(ws->arena + e->off, e->len, e->used_at);
+            }
+            close(history_fd);
+            if (rename(tmp, path) == -1) perror("출제 기록 정리 실패");
+        }
+    }
+
+    history_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (history_fd == -1) {
+        fprintf(stderr, "경고: 출제 기록 파일 '%s'를 열 수 없습니다. (%s)\n", path, strerror(errno));
+    }
+    else {
+        printf("출제 기록 %zu개 불러옴 (%s)\n", words, path);
+    }
+}
+
+// --- 점수 저장소 ---
+// 방과 닉네임("방이름\t닉네임")마다 점수를 기억해 다시 들어오면 돌려준다.
+// 점수가 바뀌면 이벤트 루프는 잠금 안에서 메모리 표를 고치고 변화량 레코드를
+// 대기 버퍼에 붙이기만 한다. 기록 스레드가 SCORE_COMMIT_MS 동안 모인 레코드를
+// 한 번의 write와 fdatasync로 로그에 덧붙이고(group commit), 로그가 커지면
+// 자기 사본 표로 스냅숏을 새로 써서 로그를 비운다. 시작할 때는 스냅숏을
+// mmap 해서 항목을 그대로 넣고 그 뒤의 로그만 다시 적용한다.
+//
+// 로그 파일: [SCORE_LOG_MAGIC][세대 8바이트 LE] 뒤에 레코드
+//   [키 길이 1바이트][변화량 4바이트 LE][키]
+// 스냅숏은 다음 로그의 세대(next_epoch)를 적어 두므로, 스냅숏을 쓰고 로그를
+// 바꾸기 전에 멈췄더라도 이미 합친 로그를 두 번 적용하지 않는다.
+
+#define SCORE_LOG_MAGIC "ANAGSLOG"
+#define SCORE_SNAP_MAGIC "ANAGSNAP"
+#define SCORE_SNAP_VERSION 1
+#define SCORE_LOG_HDR 16
+
+// 스냅숏 파일 맨 앞. 값은 리틀 엔디언이며 mmap 해서 그대로 읽는다.
+struct score_snap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t next_epoch;    // 이 스냅숏에 이어지는 로그의 세대
+    uint64_t entries_off;
+    uint64_t text_off;
+    uint64_t text_size;
+};
+
+struct score_snap_entry {
+    uint32_t text_off;      // 문자열 영역 내 키 위치
+    int32_t score;
+    uint8_t len;
+    uint8_t pad[3];
+};
+
+_Static_assert(sizeof(struct score_snap_header) == 48, "score_snap_header 크기");
+_Static_assert(sizeof(struct score_snap_entry) == 12, "score_snap_entry 크기");
+
+static struct score_entry* score_slot(struct score_table* t, const char* k, size_t len, uint64_t h) {
+    size_t mask = t->cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        struct score_entry* e = &t->slots[i];
+        if (e->len == 0) return e;
+        if (e->hash == h && e->len == len && memcmp(t->arena + e->off, k, len) == 0) return e;
+    }
+}
+
+static int score_grow(struct score_table* t) {
+    size_t cap = t->cap ? t->cap * 2 : 1024;
+    struct score_entry* old = t->slots;
+    size_t old_cap = t->cap;
+
+    t->slots = calloc(cap, sizeof(*t->slots));
+    if (t->slots == NULL) {
+        t->slots = old;
+        return -1;
+    }
+    t->cap = cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].len == 0) continue;
+        *score_slot(t, t->arena + old[i].off, old[i].len, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// 키의 점수를 돌려준다. 없으면 0.
+static int score_get(struct score_table* t, const char* k, size_t len) {
+    if (t->count == 0) return 0;
+    return score_slot(t, k, len, hash_bytes(k, len))->score;
+}
+
+// 키의 점수에 delta를 더한다. 없으면 0점으로 만든다.
+static int score_add(struct score_table* t, const char* k, size_t len, int delta) {
+    if (len == 0 || len > 255) return -1;
+    if ((t->count + 1) * 4 > t->cap * 3 && score_grow(t) == -1) return -1;
+
+    uint64_t h = hash_bytes(k, len);
+    struct score_entry* e = score_slot(t, k, len, h);
+    if (e->len == 0) {
+        if (t->arena_len + len > t->arena_cap) {
+            size_t cap = t->arena_cap ? t->arena_cap * 2 : 16384;
+            while (cap < t->arena_len + len) cap *= 2;
+            char* arena = realloc(t->arena, cap);
+            if (arena == NULL) return -1;
+            t->arena = arena;
+            t->arena_cap = cap;
+        }
+        memcpy(t->arena + t->arena_len, k, len);
+        e->hash = h;
+        e->off = t->arena_len;
+        e->len = len;
+        e->score = 0;
+        t->arena_len += len;
+        t->count++;
+    }
+    e->score += delta;
+    return 0;
+}
+
+static int score_table_copy(struct score_table* dst, const struct score_table* src) {
+    memset(dst, 0, sizeof(*dst));
+    if (src->cap == 0) return 0;
+    dst->slots = malloc(src->cap * sizeof(*src->slots));
+    dst->arena = malloc(src->arena_cap);
+    if (dst->slots == NULL || dst->arena == NULL) return -1;
+    memcpy(dst->slots, src->slots, src->cap * sizeof(*src->slots));
+    memcpy(dst->arena, src->arena, src->arena_len);
+    dst->cap = src->cap;
+    dst->count = src->count;
+    dst->arena_len = src->arena_len;
+    dst->arena_cap = src->arena_cap;
+    return 0;
+}
+
+// 점수 키는 "방이름\t닉네임"이다. 로비는 샤드 수와 상관없이 하나(DEFAULT_ROOM)라
+// 다른 샤드로 다시 접속하거나 -t를 바꿔 재시작해도 같은 키가 된다.
+static size_t score_key(const struct room* r, const char* nick, char* out) {
+    int n = snprintf(out, 256, "%s\t%s", r->name, nick);
+    return n < 0 ? 0 : n > 255 ? 255 : n;
+}
+
+static void put_le64(unsigned char* p, uint64_t v) {
+    put_le32(p, (uint32_t)v);
+    put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t get_le64(const unsigned char* p) {
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+// 로그 레코드를 적용한다. 끝까지 온전한 레코드의 길이를 돌려준다.
+static size_t score_replay(const unsigned char* data, size_t size, size_t* records) {
+    size_t pos = 0;
+    while (pos + 5 <= size && pos + 5 + data[pos] <= size) {
+        score_add(&scores.live, (const char*)data + pos + 5, data[pos], (int32_t)get_le32(data + pos + 1));
+        pos += 5 + data[pos];
+        (*records)++;
+    }
+    return pos;
+}
+
+// 세대 epoch의 빈 로그를 새로 만들어 기존 로그와 바꾼다.
+static int score_log_reset(uint64_t epoch) {
+    char tmp[512];
+    unsigned char hdr[SCORE_LOG_HDR];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", scores.log_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) return -1;
+    memcpy(hdr, SCORE_LOG_MAGIC, 8);
+    put_le64(hdr + 8, epoch);
+    if (write(fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) || fsync(fd) == -1 || rename(tmp, scores.log_path) == -1) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if (scores.log_fd != -1) close(scores.log_fd);
+    scores.log_fd = open(scores.log_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    scores.epoch = epoch;
+    scores.log_records = 0;
+    return scores.log_fd == -1 ? -1 : 0;
+}
+
+// 기록 스레드의 사본 표를 스냅숏으로 쓰고 로그를 다음 세대로 비운다.
+static void score_compact(void) {
+    struct score_table* t = &scores.durable;
+    size_t entries_off = sizeof(struct score_snap_header);
+    size_t text_off = entries_off + t->count * sizeof(struct score_snap_entry);
+    size_t size = text_off + t->arena_len;
+    char* buf = calloc(1, size);
+    if (buf == NULL) return;
+
+    struct score_snap_header* h = (struct score_snap_header*)buf;
+    memcpy(h->magic, SCORE_SNAP_MAGIC, sizeof(h->magic));
+    h->version = SCORE_SNAP_VERSION;
+    h->count = t->count;
+    h->next_epoch = scores.epoch + 1;
+    h->entries_off = entries_off;
+    h->text_off = text_off;
+    h->text_size = t->arena_len;
+    struct score_snap_entry* out = (struct score_snap_entry*)(buf + entries_off);
+    for (size_t i = 0; i < t->cap; i++) {
+        if (t->slots[i].len == 0) continue;
+        out->text_off = t->slots[i].off;
+        out->score = t->slots[i].score;
+        out->len = t->slots[i].len;
+        out++;
+    }
+    memcpy(buf + text_off, t->arena, t->arena_len);
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", scores.snap_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    size_t done = 0;
+    while (fd != -1 && done < size) {
+        ssize_t n = write(fd, buf + done, size - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    free(buf);
+    if (fd == -1 || done < size || fsync(fd) == -1) {
+        perror("점수 스냅숏 저장 실패");
+        if (fd != -1) close(fd);
         return;
     }
+    close(fd);
+    if (rename(tmp, scores.snap_path) == -1 || score_log_reset(scores.epoch + 1) == -1) {
+        perror("점수 로그 정리 실패");
+    }
+}
 
-    char lcd_output_buffer[33];
-    memset(lcd_output_buffer, 0, sizeof(lcd_output_buffer));
+// 기록 스레드: 모인 레코드를 한 번에 로그에 쓰고 fdatasync 한다.
+static void* score_writer(void* arg) {
+    (void)arg;
+    char* batch = NULL;
+    size_t batch_cap = 0;
 
-    int msg_len = strlen(msg);
-    int current_char_idx = 0;
-    int buffer_idx = 0;
+    while (1) {
+        pthread_mutex_lock(&scores.lock);
+        while (scores.pending_len == 0) {
+            pthread_cond_wait(&scores.wake, &scores.lock);
+        }
+        pthread_mutex_unlock(&scores.lock);
 
-    while (current_char_idx < msg_len && buffer_idx < 16) {
-        if (msg[current_char_idx] == '\n') {
-            current_char_idx++;
-            break;
+        // 잠시 더 모아서 한 번에 쓴다.
+        struct timespec ts = { 0, SCORE_COMMIT_MS * 1000000L };
+        nanosleep(&ts, NULL);
+
+        pthread_mutex_lock(&scores.lock);
+        char* full = scores.pending;
+        size_t len = scores.pending_len;
+        size_t cap = scores.pending_cap;
+        scores.pending = batch;
+        scores.pending_cap = batch_cap;
+        scores.pending_len = 0;
+        pthread_mutex_unlock(&scores.lock);
+        batch = full;
+        batch_cap = cap;
+
+        size_t done = 0;
+        while (scores.log_fd != -1 && done < len) {
+            ssize_t n = write(scores.log_fd, batch + done, len - done);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) {
+                perror("점수 로그 쓰기 실패");
+                break;
+            }
+            done += n;
+        }
+        if (scores.log_fd != -1 && fdatasync(scores.log_fd) == -1) perror("점수 로그 fdatasync 실패");
+
+        for (size_t pos = 0; pos < len; pos += 5 + (unsigned char)batch[pos]) {
+            const unsigned char* rec = (const unsigned char*)batch + pos;
+            score_add(&scores.durable, (const char*)rec + 5, rec[0], (int32_t)get_le32(rec + 1));
+            scores.log_records++;
+        }
+        if (scores.log_records > SCORE_COMPACT_MIN && scores.log_records > scores.durable.count * 2) {
+            score_compact();
         }
-        lcd_output_buffer[buffer_idx++] = msg[current_char_idx++];
     }
+    return NULL;
+}
+
+// 방 r에서 nick의 저장된 점수
+int score_load(struct room* r, const char* nick) {
+    char key[256];
+    size_t len = score_key(r, nick, key);
+    pthread_mutex_lock(&scores.lock);
+    int score = score_get(&scores.live, key, len);
+    pthread_mutex_unlock(&scores.lock);
+    return score;
+}
 
-    while (buffer_idx < 16) {
-        lcd_output_buffer[buffer_idx++] = ' ';
+// 대기 버퍼에 로그 레코드를 붙인다. scores.lock 안에서 부른다.
+static void score_pending_put(const char* key, size_t len, int delta) {
+    if (scores.pending_len + 5 + len > scores.pending_cap) {
+        size_t cap = scores.pending_cap ? scores.pending_cap * 2 : 65536;
+        char* p = realloc(scores.pending, cap);
+        if (p == NULL) return; // 메모리 표에는 남아 있다
+        scores.pending = p;
+        scores.pending_cap = cap;
     }
+    unsigned char* rec = (unsigned char*)scores.pending + scores.pending_len;
+    rec[0] = len;
+    put_le32(rec + 1, (uint32_t)delta);
+    memcpy(rec + 5, key, len);
+    if (scores.pending_len == 0) pthread_cond_signal(&scores.wake);
+    scores.pending_len += 5 + len;
+}
+
+// 점수 변화를 메모리 표에 반영하고 로그 레코드를 대기 버퍼에 붙인다.
+// 디스크에는 기록 스레드가 쓴다.
+void score_record(struct room* r, const char* nick, int delta) {
+    char key[256];
+    size_t len = score_key(r, nick, key);
+    pthread_mutex_lock(&scores.lock);
+    score_add(&scores.live, key, len, delta);
+    if (scores.enabled) score_pending_put(key, len, delta);
+    pthread_mutex_unlock(&scores.lock);
+}
 
-    lcd_output_buffer[buffer_idx++] = '\n';
+// 스냅숏을 mmap 해서 불러오고 그 뒤의 로그를 다시 적용한 다음 기록 스레드를
+// 띄운다. path.snap, path.log 두 파일을 쓴다.
+void score_open(const char* path) {
+    long long started = now_ms();
+    static char log_path[512], snap_path[512];
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    snprintf(snap_path, sizeof(snap_path), "%s.snap", path);
+    scores.log_path = log_path;
+    scores.snap_path = snap_path;
 
-    while (current_char_idx < msg_len && buffer_idx < 32) {
-        if (msg[current_char_idx] == '\n') {
-            current_char_idx++;
-            break;
+    uint64_t next_epoch = 0;
+    size_t snap_count = 0;
+    int fd = open(snap_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct score_snap_header)) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        const struct score_snap_header* h = map;
+        uint64_t size = st.st_size;
+        if (map == MAP_FAILED) {
+            perror("점수 스냅숏 mmap 실패");
+        }
+        else if (memcmp(h->magic, SCORE_SNAP_MAGIC, sizeof(h->magic)) != 0 || h->version != SCORE_SNAP_VERSION
+            || h->entries_off + (uint64_t)h->count * sizeof(struct score_snap_entry) > size
+            || h->text_off + h->text_size > size) {
+            fprintf(stderr, "경고: '%s'는 올바른 점수 스냅숏이 아닙니다.\n", snap_path);
+            munmap(map, st.st_size);
+        }
+        else {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            const struct score_snap_entry* e = (const struct score_snap_entry*)((const char*)map + h->entries_off);
+            const char* text = (const char*)map + h->text_off;
+            for (uint32_t i = 0; i < h->count; i++) {
+                if (e[i].text_off + (uint64_t)e[i].len > h->text_size) continue;
+                score_add(&scores.live, text + e[i].text_off, e[i].len, e[i].score);
+            }
+            next_epoch = h->next_epoch;
+            snap_count = h->count;
+            munmap(map, st.st_size);
         }
-        lcd_output_buffer[buffer_idx++] = msg[current_char_idx++];
     }
+    if (fd != -1) close(fd);
 
-    while (buffer_idx < 32) {
-        lcd_output_buffer[buffer_idx++] = ' ';
+    // 스냅숏에 이어지는 세대의 로그만 적용한다. 더 오래된 로그는 이미 합쳐졌다.
+    size_t records = 0;
+    int log_ok = 0;
+    fd = open(log_path, O_RDWR | O_CLOEXEC);
+    if (fd != -1 && fstat(fd, &st) == 0 && st.st_size >= SCORE_LOG_HDR) {
+        unsigned char* data = malloc(st.st_size);
+        size_t got = 0;
+        while (data && got < (size_t)st.st_size) {
+            ssize_t n = read(fd, data + got, st.st_size - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        if (data && got >= SCORE_LOG_HDR && memcmp(data, SCORE_LOG_MAGIC, 8) == 0
+            && get_le64(data + 8) >= next_epoch) {
+            next_epoch = get_le64(data + 8);
+            size_t valid = SCORE_LOG_HDR + score_replay(data + SCORE_LOG_HDR, got - SCORE_LOG_HDR, &records);
+            // 쓰다 멈춘 마지막 레코드는 잘라 낸다.
+            if (valid < got && ftruncate(fd, valid) == -1) perror("점수 로그 정리 실패");
+            log_ok = 1;
+        }
+        free(data);
     }
+    if (fd != -1) close(fd);
 
-    lcd_output_buffer[buffer_idx] = '\0';
+    scores.epoch = next_epoch;
+    if (log_ok) {
+        scores.log_fd = open(log_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        scores.log_records = records;
+    }
+    else if (score_log_reset(next_epoch) == -1) {
+        scores.log_fd = -1;
+    }
+    if (scores.log_fd == -1) {
+        fprintf(stderr, "경고: 점수 로그 '%s'를 열 수 없습니다. 점수가 저장되지 않습니다. (%s)\n", log_path, strerror(errno));
+        return;
+    }
 
-    ssize_t bytes_written = write(lcd_fd, lcd_output_buffer, strlen(lcd_output_buffer));
-    if (bytes_written == -1) {
-        perror("LCD 장치에 쓰기 실패");
+    pthread_t thread;
+    if (score_table_copy(&scores.durable, &scores.live) == -1
+        || pthread_create(&thread, NULL, score_writer, NULL) != 0) {
+        fprintf(stderr, "경고: 점수 기록 스레드를 띄울 수 없습니다. 점수가 저장되지 않습니다.\n");
+        close(scores.log_fd);
+        scores.log_fd = -1;
+        return;
     }
+    pthread_detach(thread);
+    scores.enabled = 1;
+    printf("점수 %zu개 불러옴 (스냅숏 %zu개 + 로그 %zu개, %lldms, %s)\n",
+        scores.live.count, snap_count, records, now_ms() - started, path);
 }
 
-int main() {
-    srand(time(NULL));
-    int serv_sock, clnt_sock;
-    struct sockaddr_in serv_addr, clnt_addr;
-    socklen_t clnt_addr_size;
-    fd_set reads, cpy_reads;
-    int fd_max;
-    char buf[BUF_SIZE];
+// --- 애너그램 사전 ---
+// 사전 파일을 통째로 읽어 그 버퍼를 단어 문자열 저장소로 쓴다. 단어 표는
+// 단어 해시로, 서명 표는 글자 구성 서명으로 찾는 오픈 어드레싱 표다.
+// 서명(wp_letter_sig)은 글자마다 섞은 값을 더한 것이라 순서와 무관하고
+// O(길이)로 구하며, 충돌은 글자 히스토그램 비교로 걸러낸다. 시작할 때 만든
+// 뒤로는 읽기만 하므로 샤드끼리 잠금 없이 함께 쓴다.
 
-    lcd_fd = open(LCD_DEVICE_PATH, O_WRONLY);
-    if (lcd_fd == -1) {
-        fprintf(stderr, "경고: '%s'를 열 수 없습니다. LCD 출력이 비활성화됩니다. (%s)\n", LCD_DEVICE_PATH, strerror(errno));
+static struct dict_word* dict_slot(const char* w, size_t len, uint64_t h) {
+    size_t mask = dict.cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        struct dict_word* d = &dict.words[i];
+        if (d->len == 0) return d;
+        if (d->hash == h && d->len == len && memcmp(dict.text + d->off, w, len) == 0) return d;
     }
-    else {
-        printf("I2C LCD 장치 '%s' 열림.\n", LCD_DEVICE_PATH);
-        send_to_lcd("Server Started!\nPort:8888");
+}
+
+static struct sig_group* dict_group(uint64_t sig) {
+    size_t mask = dict.group_cap - 1;
+    for (size_t i = sig & mask; ; i = (i + 1) & mask) {
+        struct sig_group* g = &dict.groups[i];
+        if (g->count == 0 || g->sig == sig) return g;
     }
+}
 
-    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serv_addr.sin_port = htons(8888);
+// 정규화한 단어가 사전에 있는지
+int dict_contains(const char* w, size_t len) {
+    if (dict.count == 0 || len == 0 || len > 255) return 0;
+    return dict_slot(w, len, hash_bytes(w, len))->len != 0;
+}
 
-    bind(serv_sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr));
-    listen(serv_sock, 5);
+// w와 글자 구성이 같은 사전 단어(w 자신 제외) 수를 센다. out이 있으면
+// 처음 max개를 담는다.
+int dict_anagrams(const char* w, size_t len, uint64_t sig, const char** out, int max) {
+    if (dict.count == 0) return 0;
+    struct sig_group* g = dict_group(sig);
+    struct letter_hist hist;
+    uint32_t units[QUIZ_MAX_UNITS];
+    int units_len = word_units(w, len, 0, units, QUIZ_MAX_UNITS);
+    if (g->count == 0 || units_len < 0) return 0;
+    hist_build(&hist, units, units_len);
 
-    FD_ZERO(&reads);
-    FD_SET(serv_sock, &reads);
-    fd_max = serv_sock;
+    int n = 0;
+    for (uint32_t id = g->first; id; id = dict.words[id - 1].sig_next) {
+        struct dict_word* d = &dict.words[id - 1];
+        const char* dw = dict.text + d->off;
+        // 글자 구성이 같으면 UTF-8 바이트 수도 같다.
+        if (d->len != len || memcmp(dw, w, len) == 0) continue;
+        if (word_units(dw, len, 0, units, QUIZ_MAX_UNITS) != units_len
+            || !hist_match(&hist, units, units_len)) continue;
+        if (out && n < max) out[n] = dw;
+        n++;
+    }
+    return n;
+}
 
-    printf("서버 시작 (포트 8888)\n");
+// 한 줄에 한 단어씩 있는 사전 파일을 읽어 색인을 만든다.
+void dict_load(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "경고: 사전 파일 '%s'를 열 수 없습니다. (%s)\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return;
+    }
+    dict.text = malloc(st.st_size + 1);
+    size_t got = 0;
+    while (dict.text && got < (size_t)st.st_size) {
+        ssize_t n = read(fd, dict.text + got, st.st_size - got);
+        if (n <= 0) break;
+        got += n;
+    }
+    close(fd);
+    if (dict.text == NULL) return;
+    dict.text[got] = '\0';
 
-    while (1) {
-        cpy_reads = reads;
-        if (select(fd_max + 1, &cpy_reads, 0, 0, NULL) == -1) break;
-
-        for (int i = 0; i <= fd_max; i++) {
-            if (FD_ISSET(i, &cpy_reads)) {
-                if (i == serv_sock) {
-                    clnt_addr_size = sizeof(clnt_addr);
-                    clnt_sock = accept(serv_sock, (struct sockaddr*)&clnt_addr, &clnt_addr_size);
-
-                    if (num_clients >= MAX_CLIENT) {
-                        char* msg = "서버가 꽉 찼습니다.\n";
-                        write(clnt_sock, msg, strlen(msg));
-                        close(clnt_sock);
-                        continue;
-                    }
-
-                    FD_SET(clnt_sock, &reads);
-                    if (fd_max < clnt_sock) fd_max = clnt_sock;
-                    client_socks[num_clients] = clnt_sock;
-
-                    write(clnt_sock, "닉네임을 입력하세요: ", 30);
-                    int name_len = read(clnt_sock, client_names[num_clients], 30);
-                    client_names[num_clients][strcspn(client_names[num_clients], "\n")] = 0;
-                    scores[num_clients] = 0;
-                    num_clients++;
-
-                    char join_msg[100];
-                    sprintf(join_msg, "👤 %s 님이 입장하였습니다.\n", client_names[num_clients - 1]);
-                    broadcast(-1, join_msg);
-                    printf("연결됨: %s\n", client_names[num_clients - 1]);
-
-                    char lcd_player_msg[33];
-                    snprintf(lcd_player_msg, sizeof(lcd_player_msg), "Players: %d", num_clients);
-                    send_to_lcd(lcd_player_msg);
+    size_t lines = 1;
+    for (size_t i = 0; i < got; i++) {
+        if (dict.text[i] == '\n') lines++;
+    }
+    dict.cap = 1024;
+    while (dict.cap * 3 < lines * 4) dict.cap *= 2;
+    dict.words = calloc(dict.cap, sizeof(*dict.words));
+    if (dict.words == NULL) return;
 
-                }
-                else {
-                    int str_len = read(i, buf, BUF_SIZE - 1);
-                    if (str_len <= 0) {
-                        int idx = get_client_index(i);
-                        if (idx == -1) continue;
-
-                        printf("연결 종료: %s\n", client_names[idx]);
-
-                        char leave_msg[100];
-                        sprintf(leave_msg, "👤 %s 님이 나갔습니다.\n", client_names[idx]);
-                        broadcast(-1, leave_msg);
-
-                        close(i);
-                        FD_CLR(i, &reads);
-                        for (int k = idx; k < num_clients - 1; k++) {
-                            client_socks[k] = client_socks[k + 1];
-                            strcpy(client_names[k], client_names[k + 1]);
-                            scores[k] = scores[k + 1];
-                        }
-                        num_clients--;
-
-                        char lcd_player_msg[33];
-                        snprintf(lcd_player_msg, sizeof(lcd_player_msg), "Players: %d", num_clients);
-                        send_to_lcd(lcd_player_msg);
-
-                    }
-                    else {
-                        buf[str_len] = '\0';
-                        buf[strcspn(buf, "\n")] = '\0';
-                        int idx = get_client_index(i);
-                        if (idx == -1) continue;
-
-                        if (strcmp(buf, "!exit") == 0) {
-                            write(i, "종료합니다.\n", 20);
-                            close(i);
-                            FD_CLR(i, &reads);
-
-                            char msg[100];
-                            sprintf(msg, "👤 %s 님이 나갔습니다.\n", client_names[idx]);
-                            broadcast(-1, msg);
-
-                            for (int k = idx; k < num_clients - 1; k++) {
-                                client_socks[k] = client_socks[k + 1];
-                                strcpy(client_names[k], client_names[k + 1]);
-                                scores[k] = scores[k + 1];
-                            }
-                            num_clients--;
-
-                            char lcd_player_msg[33];
-                            snprintf(lcd_player_msg, sizeof(lcd_player_msg), "Players: %d", num_clients);
-                            send_to_lcd(lcd_player_msg);
-                        }
-                        else if (strncmp(buf, "!quiz ", 6) == 0) {
-                            if (quiz_active) {
-                                write(i, " 이미 퀴즈가 진행 중입니다.\n", 60);
-                            }
-                            else {
-                                char* new_word = buf + 6;
-                                if (strlen(new_word) < 2 || strlen(new_word) >= sizeof(current_answer)) {
-                                    write(i, " 퀴즈 단어는 2글자 이상, 99글자 이하로 입력해주세요.\n", 80);
-                                    continue;
-                                }
-
-                                int duplicate = 0;
-                                for (int h = 0; h < quiz_history_count; h++) {
-                                    if (strcmp(new_word, quiz_history[h]) == 0) {
-                                        duplicate = 1;
-                                        break;
-                                    }
-                                }
-                                if (duplicate) {
-                                    write(i, " 이미 출제된 단어입니다.\n", 60);
-                                }
-                                else {
-                                    strcpy(current_answer, new_word);
-                                    strcpy(quiz_history[quiz_history_count++], current_answer);
-                                    char quiz_shuffled[100];
-                                    shuffle(current_answer, quiz_shuffled);
-                                    char quiz_msg[150];
-                                    snprintf(quiz_msg, sizeof(quiz_msg), "🧠 [퀴즈] %s 님이 문제 출제: %s\n", client_names[idx], quiz_shuffled);
-                                    broadcast(-1, quiz_msg);
-                                    quiz_active = 1;
-                                    quiz_start_time = time(NULL);
-
-                                    char lcd_quiz_msg[33];
-                                    snprintf(lcd_quiz_msg, sizeof(lcd_quiz_msg), "QUIZ:%.16s\n%s", new_word, quiz_shuffled);
-                                    send_to_lcd(lcd_quiz_msg);
-                                }
-                            }
-                        }
-                        else if (strcmp(buf, "!score") == 0) {
-                            char score_msg[512] = "[점수판]\n";
-
-                            int top_score = -1;
-                            char top_scorer_name[30] = "No players";
-                            if (num_clients > 0) {
-                                top_score = scores[0];
-                                strcpy(top_scorer_name, client_names[0]);
-                                for (int s = 1; s < num_clients; s++) {
-                                    if (scores[s] > top_score) {
-                                        top_score = scores[s];
-                                        strcpy(top_scorer_name, client_names[s]);
-                                    }
-                                }
-                            }
-
-                            for (int s = 0; s < num_clients; s++) {
-                                char line[100];
-                                sprintf(line, "%s: %d점\n", client_names[s], scores[s]);
-                                strcat(score_msg, line);
-                            }
-                            write(i, score_msg, strlen(score_msg));
-
-                            char temp_lcd_score[33];
-                            if (num_clients > 0) {
-                                snprintf(temp_lcd_score, sizeof(temp_lcd_score), "Top Score!\n%.16s: %d", top_scorer_name, top_score);
-                            }
-                            else {
-                                snprintf(temp_lcd_score, sizeof(temp_lcd_score), "Scoreboard\nNo Players");
-                            }
-                            send_to_lcd(temp_lcd_score);
-                        }
-                        else if (strcmp(buf, "!rank") == 0) {
-                            int temp_score[MAX_CLIENT];
-                            char temp_name[MAX_CLIENT][30];
-                            for (int t = 0; t < num_clients; t++) {
-                                temp_score[t] = scores[t];
-                                strcpy(temp_name[t], client_names[t]);
-                            }
-
-                            for (int x = 0; x < num_clients - 1; x++) {
-                                for (int y = x + 1; y < num_clients; y++) {
-                                    if (temp_score[x] < temp_score[y]) {
-                                        int ts = temp_score[x];
-                                        temp_score[x] = temp_score[y];
-                                        temp_score[y] = ts;
-                                        char tn[30];
-                                        strcpy(tn, temp_name[x]);
-                                        strcpy(temp_name[x], temp_name[y]);
-                                        strcpy(temp_name[y], tn);
-                                    }
-                                }
-                            }
-
-                            char rank_msg[512] = "[🏆 순위표]\n";
-                            for (int r = 0; r < num_clients; r++) {
-                                char line[100];
-                                sprintf(line, "%d위: %s (%d점)\n", r + 1, temp_name[r], temp_score[r]);
-                                strcat(rank_msg, line);
-                            }
-                            write(i, rank_msg, strlen(rank_msg));
-
-                            char lcd_rank_msg[33];
-                            if (num_clients >= 2) {
-                                snprintf(lcd_rank_msg, sizeof(lcd_rank_msg), "1st:%.8s %d\n2nd:%.8s %d",
-                                    temp_name[0], temp_score[0], temp_name[1], temp_score[1]);
-                            }
-                            else if (num_clients == 1) {
-                                snprintf(lcd_rank_msg, sizeof(lcd_rank_msg), "1st:%.8s %d\n", temp_name[0], temp_score[0]);
-                            }
-                            else {
-                                snprintf(lcd_rank_msg, sizeof(lcd_rank_msg), "Rankings\nNo Players");
-                            }
-                            send_to_lcd(lcd_rank_msg);
-                        }
-                        else if (quiz_active) {
-                            time_t now = time(NULL);
-                            if (difftime(now, quiz_start_time) > 15.0) {
-                                write(i, "⏰ 제한 시간이 초과되었습니다. 퀴즈 종료.\n", 60);
-
-                                char timeout_broadcast_msg[150];
-                                snprintf(timeout_broadcast_msg, sizeof(timeout_broadcast_msg),
-                                    "⏰ 퀴즈 제한 시간 초과! 정답은: %s%s%s\n",
-                                    YELLOW, current_answer, RESET);
-                                broadcast(-1, timeout_broadcast_msg);
-
-                                char lcd_timeout_msg[33];
-                                snprintf(lcd_timeout_msg, sizeof(lcd_timeout_msg), "Time's Up!\nAns: %.16s", current_answer);
-                                send_to_lcd(lcd_timeout_msg);
-
-                                quiz_active = 0;
-                                current_answer[0] = '\0';
-                            }
-                            else if (strcmp(buf, current_answer) == 0) {
-                                scores[idx]++;
-                                char win_msg[150];
-                                snprintf(win_msg, sizeof(win_msg), "🎉 정답! %s 님이 %s을(를) 맞췄습니다! (+1점)\n", client_names[idx], current_answer);
-                                broadcast(-1, win_msg);
-                                quiz_active = 0;
-
-                                char lcd_win_msg[33];
-                                snprintf(lcd_win_msg, sizeof(lcd_win_msg), "WINNER:%.16s\nAns:%.16s", client_names[idx], current_answer);
-                                send_to_lcd(lcd_win_msg);
-                                current_answer[0] = '\0';
-                            }
-                            else {
-                                char wrong_answer_msg[100];
-                                snprintf(wrong_answer_msg, sizeof(wrong_answer_msg), RED "❌ 틀렸습니다. 다시 시도하세요.\n" RESET);
-                                write(i, wrong_answer_msg, strlen(wrong_answer_msg));
-
-                                char broadcast_wrong_msg[100];
-                                snprintf(broadcast_wrong_msg, sizeof(broadcast_wrong_msg), "%s%s 님이 오답을 시도했습니다.\n%s", CYAN, client_names[idx], RESET);
-                                broadcast(i, broadcast_wrong_msg);
-                            }
-                        }
-                        else {
-                            char chat_msg[BUF_SIZE + 50];
-                            sprintf(chat_msg, "%s: %s\n", client_names[idx], buf);
-                            broadcast(i, chat_msg);
-                        }
-                    }
-                }
+    // 줄마다 앞뒤 공백을 잘라 소문자로 바꾸고 그 자리에서 끝에 '\0'을 둔다.
+    char* p = dict.text;
+    char* end = dict.text + got;
+    while (p < end) {
+        char* nl = memchr(p, '\n', end - p);
+        if (nl == NULL) nl = end;
+        *nl = '\0';
+        size_t len = normalize_word(p, p, nl - p + 1);
+        int chars = utf8_count(p, len);
+        if (chars >= 2 && chars <= QUIZ_MAX_CHARS) {
+            uint64_t h = hash_bytes(p, len);
+            struct dict_word* d = dict_slot(p, len, h);
+            if (d->len == 0) {
+                d->hash = h;
+                d->sig = wp_letter_sig(p, len);
+                d->off = p - dict.text;
+                d->len = len;
+                dict.count++;
             }
         }
+        p = nl + 1;
     }
 
-    if (lcd_fd != -1) {
-        close(lcd_fd);
-        printf("I2C LCD 장치 '%s' 닫힘.\n", LCD_DEVICE_PATH);
+    dict.group_cap = 1024;
+    while (dict.group_cap * 3 < dict.count * 4) dict.group_cap *= 2;
+    dict.groups = calloc(dict.group_cap, sizeof(*dict.groups));
+    if (dict.groups == NULL) {
+        dict.count = 0;
+        return;
     }
-    close(serv_sock);
-    return 0;
+    for (size_t i = 0; i < dict.cap; i++) {
+        struct dict_word* d = &dict.words[i];
+        if (d->len == 0) continue;
+        struct sig_group* g = dict_group(d->sig);
+        if (g->count == 0) dict.group_count++;
+        g->sig = d->sig;
+        d->sig_next = g->count ? g->first : 0;
+        g->first = i + 1;
+        g->count++;
+    }
+    printf("사전 단어 %zu개 불러옴 (글자 조합 %zu개, %s)\n", dict.count, dict.group_count, path);
+}
+
+// --- 자동 출제 단어 풀 ---
+// wordpool 도구가 미리 만든 파일을 mmap 해서 그대로 쓴다. 읽어 들이거나
+// 가공하는 단계가 없어 단어 수와 관계없이 바로 시작하며, 페이지는 실제로
+// 뽑힌 단어만 올라온다.
+
+// 헤더의 구간과 항목마다 가리키는 문자열이 파일 안에 있는지 본다. 잘렸거나
+// 망가진 파일이면 0. 합이 넘치지 않도록 남은 크기와 비교한다.
+static int pool_valid(const struct wordpool_header* h, uint64_t size) {
+    if (memcmp(h->magic, WORDPOOL_MAGIC, sizeof(h->magic)) != 0 || h->version != WORDPOOL_VERSION) return 0;
+    if (h->entries_off > size || h->entries_off % _Alignof(struct wordpool_entry) != 0
+        || (uint64_t)h->word_count > (size - h->entries_off) / sizeof(struct wordpool_entry)) return 0;
+    if (h->text_off > size || h->text_size > size - h->text_off) return 0;
+    for (int t = 0; t < WP_TIERS; t++) {
+        if (h->tier_start[t] > h->tier_start[t + 1]) return 0;
+    }
+    if (h->tier_start[0] != 0 || h->tier_start[WP_TIERS] != h->word_count) return 0;
+
+    const struct wordpool_entry* e = (const struct wordpool_entry*)((const char*)h + h->entries_off);
+    const char* text = (const char*)h + h->text_off;
+    for (uint32_t i = 0; i < h->word_count; i++) {
+        // 단어는 '\0'으로 끝나야 하고, 퀴즈 상태에 복사하므로 버퍼보다 짧아야 한다.
+        if ((uint64_t)e[i].text_off + e[i].len + 1 > h->text_size || e[i].len >= QUIZ_WORD_SIZE
+            || text[e[i].text_off + e[i].len] != '\0') return 0;
+    }
+    return 1;
+}
+
+void pool_open(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "경고: 단어 풀 '%s'를 열 수 없습니다. 자동 출제가 비활성화됩니다. (%s)\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return;
+    }
+    void* map = st.st_size >= (off_t)sizeof(struct wordpool_header)
+        ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "경고: 단어 풀 '%s'를 mmap 할 수 없습니다.\n", path);
+        return;
+    }
+
+    const struct wordpool_header* h = map;
+    uint64_t size = st.st_size;
+    if (!pool_valid(h, size)) {
+        fprintf(stderr, "경고: '%s'는 올바른 단어 풀 파일이 아닙니다.\n", path);
+        munmap(map, st.st_size);
+        return;
+    }
+    // 단어는 무작위 순서로 읽는다.
+    madvise(map, st.st_size, MADV_RANDOM);
+
+    pool.hdr = h;
+    pool.entries = (const struct wordpool_entry*)((const char*)map + h->entries_off);
+    pool.text = (const char*)map + h->text_off;
+    printf("단어 풀 %u개 (쉬움 %u / 보통 %u / 어려움 %u, %s)\n", h->word_count,
+        h->tier_start[1] - h->tier_start[0], h->tier_start[2] - h->tier_start[1],
+        h->tier_start[3] - h->tier_start[2], path);
+}
+
+static uint32_t gcd32(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// 난이도 tier에서 다음 단어를 O(1)로 뽑는다. stride가 단어 수와 서로소이면
+// start에서 stride씩 건너뛰는 순서가 한 바퀴 동안 모든 단어를 한 번씩만
+// 지나므로, 한 바퀴를 다 돌 때까지 같은 단어가 다시 나오지 않는다.
+const struct wordpool_entry* pool_next(struct pool_cursor* cur, int tier) {
+    if (pool.hdr == NULL) return NULL;
+    uint32_t base = pool.hdr->tier_start[tier];
+    uint32_t n = pool.hdr->tier_start[tier + 1] - base;
+    if (n == 0) return NULL;
+
+    if (cur->stride == 0 || cur->step >= n) {
+        uint64_t rnd = ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+        cur->start = rnd % n;
+        cur->stride = n > 1 ? 1 + (uint32_t)(rnd >> 20) % (n - 1) : 1;
+        while (gcd32(cur->stride, n) != 1) {
+            cur->stride = cur->stride % (n - 1) + 1;
+        }
+        cur->step = 0;
+    }
+    uint32_t idx = (cur->start + (uint64_t)cur->step * cur->stride) % n;
+    cur->step++;
+    return &pool.entries[base + idx];
+}
+
+// 자동 출제 타이머: 방의 난이도에서 최근에 나오지 않은 단어로 퀴즈를 낸다.
+void auto_quiz(struct timer* t) {
+    struct room* r = container_of(t, struct room, auto_timer);
+    if (!r->auto_on || r->quiz_active) return;
+
+    time_t now = time(NULL);
+    for (int tries = 0; tries < AUTO_PICK_TRIES; tries++) {
+        const struct wordpool_entry* e = pool_next(&r->cursor[r->auto_tier], r->auto_tier);
+        if (e == NULL) break;
+        const char* word = pool.text + e->text_off;
+        if (word_set_recent(&r->history, word, e->len, now, reuse_window)) continue;
+        // 어려움 단계의 한글 단어는 자모로 풀어서 낸다.
+        quiz_start(r, word, word, e->len, e->sig, r->auto_tier == WP_TIERS - 1, NULL);
+        return;
+    }
+
+    r->auto_on = 0;
+    broadcast(r, NULL, msg_printf("🤖 이 난이도에서 더 낼 단어가 없어 자동 출제를 끕니다.\n"));
+}
+
+// --- 타이머 휠 ---
+// 샤드마다 하나씩 있는 64칸짜리 바퀴 4단의 계층형 타이머 휠. 추가/삭제는 O(1)이고, 하위
+// 바퀴가 한 바퀴 돌 때마다 상위 바퀴의 한 칸을 내려보낸다(cascade).
+// 타이머가 하나라도 있으면 timerfd 하나가 TIMER_TICK_MS마다 깨워 주므로
+// 타이머 개수와 관계없이 시스템 콜은 틱당 한 번이다.
+
+static void timer_link(struct timer* t) {
+    struct timer_wheel* w = &this_shard->wheel;
+    unsigned long long expires = t->expires;
+    unsigned long long diff = expires - w->now;
+    struct timer** slot;
+
+    if ((long long)diff < 0) {
+        slot = &w->slots[0][w->now & WHEEL_MASK];
+    }
+    else if (diff < (1ULL << WHEEL_BITS)) {
+        slot = &w->slots[0][expires & WHEEL_MASK];
+    }
+    else if (diff < (1ULL << (2 * WHEEL_BITS))) {
+        slot = &w->slots[1][(expires >> WHEEL_BITS) & WHEEL_MASK];
+    }
+    else if (diff < (1ULL << (3 * WHEEL_BITS))) {
+        slot = &w->slots[2][(expires >> (2 * WHEEL_BITS)) & WHEEL_MASK];
+    }
+    else {
+        if (diff >= (1ULL << (4 * WHEEL_BITS))) {
+            expires = w->now + (1ULL << (4 * WHEEL_BITS)) - 1;
+            t->expires = expires;
+        }
+        slot = &w->slots[3][(expires >> (3 * WHEEL_BITS)) & WHEEL_MASK];
+    }
+
+    t->prev = NULL;
+    t->next = *slot;
+    if (*slot) (*slot)->prev = t;
+    *slot = t;
+    t->slot = slot;
 }
 
-~                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                         ~                                                               
+static void timer_unlink(struct timer* t) {
+    if (t->prev) t->prev->next = t->next;
+    else *t->slot = t->next;
+    if (t->next) t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+    t->slot = NULL;
+}
+
+// timerfd는 타이머가 있을 때만 돌린다.
+static void timer_arm(int on) {
+    struct timer_wheel* w = &this_shard->wheel;
+    if (on == w->armed) return;
+    struct itimerspec its = { 0 };
+    if (on) {
+        its.it_interval.tv_nsec = TIMER_TICK_MS * 1000000L;
+        its.it_value = its.it_interval;
+    }
+    timerfd_settime(this_shard->timer_handle.fd, 0, &its, NULL);
+    w->armed = on;
+}
+
+// ms 뒤에 fn을 부른다. 이미 걸려 있으면 다시 건다.
+void timer_add(struct timer* t, long long ms, void (*fn)(struct timer*)) {
+    struct timer_wheel* w = &this_shard->wheel;
+    if (t->slot) timer_unlink(t);
+    else w->count++;
+    long long now = now_ms();
+    if (w->count == 1) {
+        // 쉬는 동안 멈춰 있던 휠의 현재 틱을 시계에 맞춘다.
+        w->now = now / TIMER_TICK_MS;
+        timer_arm(1);
+    }
+    // 휠의 틱이 아니라 시계를 기준으로 잡아야 일찍 만료되지 않는다.
+    t->fn = fn;
+    t->expires = (now + ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    timer_link(t);
+}
+
+void timer_del(struct timer* t) {
+    struct timer_wheel* w = &this_shard->wheel;
+    if (t->slot == NULL) return;
+    timer_unlink(t);
+    w->count--;
+    if (w->count == 0) timer_arm(0);
+}
+
+static int timer_cascade(int level, int idx) {
+    struct timer_wheel* w = &this_shard->wheel;
+    struct timer* t = w->slots[level][idx];
+    w->slots[level][idx] = NULL;
+    while (t) {
+        struct timer* next = t->next;
+        timer_link(t);
+        t = next;
+    }
+    return idx;
+}
+
+// 현재 시각까지 틱을 진행하며 만료된 타이머를 부른다.
+void timer_run(void) {
+    struct timer_wheel* w = &this_shard->wheel;
+    unsigned long long target = now_ms() / TIMER_TICK_MS;
+
+    while (w->count > 0 && w->now <= target) {
+        int idx = w->now & WHEEL_MASK;
+        if (idx == 0 &&
+            timer_cascade(1, (w->now >> WHEEL_BITS) & WHEEL_MASK) == 0 &&
+            timer_cascade(2, (w->now >> (2 * WHEEL_BITS)) & WHEEL_MASK) == 0) {
+            timer_cascade(3, (w->now >> (3 * WHEEL_BITS)) & WHEEL_MASK);
+        }
+
+        // 콜백이 같은 칸에 타이머를 다시 걸 수 있으므로 하나씩 떼어 낸다.
+        struct timer* t;
+        while ((t = w->slots[0][idx]) != NULL) {
+            timer_unlink(t);
+            w->count--;
+            t->fn(t);
+        }
+        w->now++;
+    }
+    if (w->count == 0) timer_arm(0);
+}
+
+void drain_timerfd(void) {
+    uint64_t ticks;
+    while (read(this_shard->timer_handle.fd, &ticks, sizeof(ticks)) > 0) {
+    }
+    timer_run();
+}
+
+struct conn* conn_by_fd(int fd) {
+    if (fd < 0 || fd >= fd_table_size) return NULL;
+    return fd_table[fd];
+}
+
+// slab에서 빈 칸을 꺼내 초기화하고 fd_table에 등록한다.
+struct conn* conn_alloc(int fd) {
+    if (fd >= fd_table_size) return NULL;
+    pthread_mutex_lock(&slab_lock);
+    int slot = free_top > 0 ? free_slots[--free_top] : -1;
+    pthread_mutex_unlock(&slab_lock);
+    if (slot == -1) return NULL;
+    struct conn* c = &conn_slab[slot];
+    memset(c, 0, sizeof(*c));
+    c->slot = slot;
+    c->fd = fd;
+    fd_table[fd] = c;
+    return c;
+}
+
+// 본문 len 바이트(+ '\0' 자리)짜리 메시지를 만들고 FR_NOTICE 헤더를 붙인다.
+static struct msg* msg_alloc(size_t len) {
+    struct msg* m = malloc(sizeof(*m) + len + 1);
+    if (m == NULL) return NULL;
+    m->refcnt = 1;
+    m->len = len;
+    uint8_t hdr[FRAME_HDR_MAX];
+    m->hdr_len = frame_header(hdr, FR_NOTICE, len);
+    memcpy(m->hdr + FRAME_HDR_MAX - m->hdr_len, hdr, m->hdr_len);
+    return m;
+}
+
+struct msg* msg_new(const char* data, size_t len) {
+    struct msg* m = msg_alloc(len);
+    if (m == NULL) return NULL;
+    memcpy(m->data, data, len);
+    return m;
+}
+
+// 프레임 종류를 정한다. 보내기 전에만 바꾼다. m을 그대로 돌려준다.
+struct msg* msg_tag(struct msg* m, uint8_t type) {
+    if (m) m->hdr[FRAME_HDR_MAX - m->hdr_len] = type;
+    return m;
+}
+
+// 종류까지 같은 사본 (다른 샤드로 넘길 때)
+struct msg* msg_copy(const struct msg* m) {
+    return msg_tag(msg_new(m->data, m->len), (uint8_t)m->hdr[FRAME_HDR_MAX - m->hdr_len]);
+}
+
+// 연결의 프로토콜에 맞춰 실제로 보낼 바이트
+static inline const char* msg_wire(const struct msg* m, int framed) {
+    return framed ? m->hdr + FRAME_HDR_MAX - m->hdr_len : m->data;
+}
+
+static inline size_t msg_wire_len(const struct msg* m, int framed) {
+    return framed ? m->len + m->hdr_len : m->len;
+}
+
+// printf 형식으로 메시지를 한 번만 만든다. 내용이 딱 맞는 크기로 할당된다.
+struct msg* msg_printf(const char* fmt, ...) {
+    char stack_buf[BUF_SIZE * 2];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(stack_buf, sizeof(stack_buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return NULL;
+    if ((size_t)n < sizeof(stack_buf)) return msg_new(stack_buf, n);
+
+    struct msg* m = msg_alloc(n);
+    if (m == NULL) return NULL;
+    va_start(ap, fmt);
+    vsnprintf(m->data, n + 1, fmt, ap);
+    va_end(ap);
+    return m;
+}
+
+struct msg* msg_ref(struct msg* m) {
+    m->refcnt++;
+    return m;
+}
+
+void msg_unref(struct msg* m) {
+    if (m && --m->refcnt == 0) free(m);
+}
+
+// 방 참가자 전체(sender 제외)에 보낸다. 수신자마다 참조만 늘리며,
+// 호출자가 넘긴 참조는 여기서 놓는다.
+void broadcast(struct room* r, struct conn* sender, struct msg* m) {
+    if (m == NULL) return;
+    uint64_t fanout = 0;
+    for (struct conn* p = r->members_head; p; p = p->next) {
+        if (p != sender) {
+            conn_send(p, m);
+            fanout++;
+        }
+    }
+    struct shard_stats* st = &this_shard->stats;
+    stat_add(&st->n.broadcasts, 1);
+    stat_add(&st->n.fanout_bytes, fanout * m->len);
+    stat_hist_add(&st->fanout, fanout);
+    msg_unref(m);
+}
+
+// 송신 중 오류가 난 연결은 순회 중인 배열을 건드리지 않도록
+// 루프 끝(close_dead)에서 정리한다.
+void mark_dead(struct conn* c) {
+    if (c->dead || c->state == CLOSING) return;
+    c->dead = 1;
+    c->dead_next = this_shard->dead_list;
+    this_shard->dead_list = c;
+}
+
+void close_dead(void) {
+    while (this_shard->dead_list) {
+        struct conn* c = this_shard->dead_list;
+        this_shard->dead_list = c->dead_next;
+        close_conn(c);
+    }
+}
+
+static void outq_free_all(struct outq* q) {
+    while (q->head != q->tail) {
+        msg_unref(q->slot[q->head++ & (OUTQ_SLOTS - 1)]);
+    }
+    q->head_off = 0;
+    q->bytes = 0;
+}
+
+// 대기열 앞쪽의 메시지를 최대 OUTQ_IOV_MAX개까지 iov에 담는다.
+static int outq_fill_iov(struct conn* c, struct iovec* iov) {
+    struct outq* q = &c->out;
+    int cnt = 0;
+    size_t off = q->head_off;
+    for (unsigned k = q->head; k != q->tail && cnt < OUTQ_IOV_MAX; k++) {
+        struct msg* m = q->slot[k & (OUTQ_SLOTS - 1)];
+        iov[cnt].iov_base = (char*)msg_wire(m, c->framed) + off;
+        iov[cnt].iov_len = msg_wire_len(m, c->framed) - off;
+        off = 0;
+        cnt++;
+    }
+    return cnt;
+}
+
+// framed 형식으로 보낸 n바이트만큼 대기열 앞쪽을 떼어 낸다.
+static void outq_consume(struct outq* q, size_t n, int framed) {
+    q->bytes -= n;
+    while (n > 0) {
+        struct msg* m = q->slot[q->head & (OUTQ_SLOTS - 1)];
+        size_t left = msg_wire_len(m, framed) - q->head_off;
+        if (n < left) {
+            q->head_off += n;
+            break;
+        }
+        n -= left;
+        q->head++;
+        q->head_off = 0;
+        msg_unref(m);
+    }
+}
+
+// 대기열을 비울 수 있는 만큼 지금 바로 writev로 보낸다. io_uring이 보내는
+// 중인 메시지가 있으면 순서가 섞이므로 부르지 않는다.
+// 다 보냈으면 0, 소켓이 가득 찼으면 1, 오류면 -1.
+static int conn_writev(struct conn* c) {
+    struct outq* q = &c->out;
+    struct iovec iov[OUTQ_IOV_MAX];
+
+    while (q->head != q->tail) {
+        int cnt = outq_fill_iov(c, iov);
+        ssize_t n = writev(c->fd, iov, cnt);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return -1;
+        }
+        outq_consume(q, n, c->framed);
+        stat_add(&this_shard->stats.n.bytes_out, n);
+    }
+    if (q->bytes < outq_high) q->over_since = 0;
+    return 0;
+}
+
+// 대기열을 보낸다. epoll이면 바로 writev 하고, io_uring이면 루프 끝에서
+// 다른 연결의 sendmsg와 함께 한 번에 제출하도록 send_list에 올린다.
+// 다 보냈으면 0, 아직 남았으면 1, 오류면 -1.
+int conn_flush(struct conn* c) {
+    if (!use_uring) return conn_writev(c);
+    if (c->out.head == c->out.tail) return 0;
+    if (!c->flush_queued) {
+        c->flush_queued = 1;
+        c->send_next = this_shard->send_list;
+        this_shard->send_list = c;
+    }
+    return 1;
+}
+
+// 밀린 메시지를 버린다. 일부만 보낸 맨 앞 메시지와 io_uring이 보내는 중인
+// 메시지는 끝까지 보내야 스트림이 깨지지 않으므로 남겨둔다.
+static int outq_squash(struct outq* q, int framed) {
+    unsigned keep = q->head + q->inflight;
+    if (q->inflight == 0 && q->head != q->tail && q->head_off > 0) keep++;
+    int dropped = 0;
+    while (q->tail != keep) {
+        struct msg* m = q->slot[--q->tail & (OUTQ_SLOTS - 1)];
+        q->bytes -= msg_wire_len(m, framed);
+        msg_unref(m);
+        dropped++;
+    }
+    return dropped;
+}
+
+static void outq_push(struct outq* q, struct msg* m, int framed) {
+    q->slot[q->tail++ & (OUTQ_SLOTS - 1)] = msg_ref(m);
+    q->bytes += msg_wire_len(m, framed);
+}
+
+// 메시지 참조를 연결의 송신 대기열에 넣고, 대기열이 비어 있었다면 바로
+// 보내본다. 내용은 복사하지 않으며 느린 클라이언트를 write에서 기다리지 않는다.
+void conn_send(struct conn* c, struct msg* m) {
+    if (c->dead || c->state == CLOSING || m == NULL || m->len == 0) return;
+    struct outq* q = &c->out;
+    int was_empty = (q->head == q->tail);
+    int full = (q->tail - q->head == OUTQ_SLOTS - 1); // 안내문 자리 하나는 남겨둔다
+
+    if (!full) {
+        outq_push(q, m, c->framed);
+        stat_hist_add(&this_shard->stats.outq, q->bytes);
+        if (was_empty && conn_flush(c) == -1) {
+            mark_dead(c);
+            return;
+        }
+        if (q->bytes < outq_high) return;
+        long long now = now_ms();
+        if (q->over_since == 0) q->over_since = now;
+        if (now - q->over_since < OUTQ_GRACE_MS && q->bytes < outq_high * 4) return;
+    }
+
+    if (outq_policy == OUTQ_DROP) {
+        stat_add(&this_shard->stats.n.dropped, 1);
+        mark_dead(c);
+        return;
+    }
+    int dropped = outq_squash(q, c->framed) + (full ? 1 : 0);
+    stat_add(&this_shard->stats.n.squashed, dropped);
+    struct msg* notice = msg_printf(YELLOW "⚠️ 수신이 밀려 메시지 %d개를 건너뛰었습니다.\n" RESET, dropped);
+    if (notice) {
+        outq_push(q, notice, c->framed);
+        msg_unref(notice);
+    }
+    q->over_since = 0;
+}
+
+void send_str(struct conn* c, const char* str) {
+    send_typed(c, FR_NOTICE, str);
+}
+
+void send_typed(struct conn* c, uint8_t type, const char* str) {
+    struct msg* m = msg_tag(msg_new(str, strlen(str)), type);
+    conn_send(c, m);
+    msg_unref(m);
+}
+
+// 길이를 모르는 응답을 만들 때 쓰는 가변 버퍼
+int sb_printf(struct strbuf* sb, const char* fmt, ...) {
+    va_list ap;
+    for (int tries = 0; tries < 2; tries++) {
+        size_t room = sb->cap - sb->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(sb->data ? sb->data + sb->len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return -1;
+        if ((size_t)n < room) {
+            sb->len += n;
+            return 0;
+        }
+        size_t cap = sb->cap ? sb->cap : 256;
+        while (cap < sb->len + n + 1) cap *= 2;
+        char* data = realloc(sb->data, cap);
+        if (data == NULL) return -1;
+        sb->data = data;
+        sb->cap = cap;
+    }
+    return -1;
+}
+
+// 버퍼 내용을 메시지로 옮기고 버퍼를 비운다.
+struct msg* sb_to_msg(struct strbuf* sb) {
+    struct msg* m = msg_new(sb->data ? sb->data : "", sb->len);
+    free(sb->data);
+    sb->data = NULL;
+    sb->len = sb->cap = 0;
+    return m;
+}
+
+// --- 순위표 ---
+// 점수마다 버킷(입장/득점 순 연결 리스트)을 두고, 버킷 인원수를 펜윅 트리로
+// 누적해 둔다. 득점은 옆 버킷으로 옮기는 O(log S), 상위 N명은 최고 점수
+// 버킷부터 내려가며 읽고, 내 순위는 나보다 점수가 높은 인원수로 구한다.
+
+static void fenwick_add(struct leaderboard* lb, int score, int delta) {
+    for (int i = score + 1; i <= lb->cap; i += i & -i) {
+        lb->tree[i] += delta;
+    }
+}
+
+// 점수가 0..score인 인원수
+static int fenwick_sum(struct leaderboard* lb, int score) {
+    int sum = 0;
+    if (score >= lb->cap) score = lb->cap - 1;
+    for (int i = score + 1; i > 0; i -= i & -i) {
+        sum += lb->tree[i];
+    }
+    return sum;
+}
+
+static int lb_reserve(struct leaderboard* lb, int score) {
+    if (score < lb->cap) return 0;
+    int cap = lb->cap ? lb->cap : 16;
+    while (cap <= score) cap *= 2;
+
+    struct score_bucket* b = realloc(lb->buckets, sizeof(*b) * cap);
+    if (b == NULL) return -1;
+    memset(b + lb->cap, 0, sizeof(*b) * (cap - lb->cap));
+    lb->buckets = b;
+
+    int* tree = realloc(lb->tree, sizeof(*tree) * (cap + 1));
+    if (tree == NULL) return -1;
+    lb->tree = tree;
+    lb->cap = cap;
+
+    // 크기가 바뀌면 펜윅 트리는 버킷 인원수로 다시 만든다.
+    memset(lb->tree, 0, sizeof(*lb->tree) * (cap + 1));
+    for (int s = 0; s < cap; s++) {
+        if (b[s].count) fenwick_add(lb, s, b[s].count);
+    }
+    return 0;
+}
+
+static void bucket_push(struct leaderboard* lb, struct conn* c) {
+    struct score_bucket* b = &lb->buckets[c->score];
+    c->lb_prev = b->tail;
+    c->lb_next = NULL;
+    if (b->tail) b->tail->lb_next = c;
+    else b->head = c;
+    b->tail = c;
+    b->count++;
+    fenwick_add(lb, c->score, 1);
+    if (c->score > lb->max_score) lb->max_score = c->score;
+}
+
+static void bucket_unlink(struct leaderboard* lb, struct conn* c) {
+    struct score_bucket* b = &lb->buckets[c->score];
+    if (c->lb_prev) c->lb_prev->lb_next = c->lb_next;
+    else b->head = c->lb_next;
+    if (c->lb_next) c->lb_next->lb_prev = c->lb_prev;
+    else b->tail = c->lb_prev;
+    c->lb_prev = c->lb_next = NULL;
+    b->count--;
+    fenwick_add(lb, c->score, -1);
+    while (lb->max_score > 0 && lb->buckets[lb->max_score].count == 0) {
+        lb->max_score--;
+    }
+}
+
+void lb_add(struct leaderboard* lb, struct conn* c) {
+    if (lb_reserve(lb, c->score) == -1) return;
+    bucket_push(lb, c);
+    lb->players++;
+    lb->version++;
+}
+
+void lb_remove(struct leaderboard* lb, struct conn* c) {
+    bucket_unlink(lb, c);
+    lb->players--;
+    lb->version++;
+}
+
+void lb_add_score(struct leaderboard* lb, struct conn* c, int delta) {
+    if (lb_reserve(lb, c->score + delta) == -1) return;
+    bucket_unlink(lb, c);
+    c->score += delta;
+    bucket_push(lb, c);
+    lb->version++;
+}
+
+// 나보다 점수가 높은 사람 수 + 1 (동점자는 같은 순위)
+int lb_rank_of(struct leaderboard* lb, struct conn* c) {
+    return lb->players - fenwick_sum(lb, c->score) + 1;
+}
+
+// 점수 내림차순 순회: 처음이면 prev=NULL
+struct conn* lb_next(struct leaderboard* lb, struct conn* prev) {
+    if (prev && prev->lb_next) return prev->lb_next;
+    for (int s = prev ? prev->score - 1 : lb->max_score; s >= 0; s--) {
+        if (lb->buckets && lb->buckets[s].head) return lb->buckets[s].head;
+    }
+    return NULL;
+}
+
+// 순위표 문자열은 점수가 바뀔 때까지 한 번 만든 메시지를 공유한다.
+struct msg* lb_rank_board(struct leaderboard* lb, int full) {
+    struct msg** cache = full ? &lb->full_cache : &lb->top_cache;
+    unsigned* ver = full ? &lb->full_ver : &lb->top_ver;
+    if (*cache && *ver == lb->version) return msg_ref(*cache);
+
+    struct strbuf sb = { 0 };
+    sb_printf(&sb, "[🏆 순위표]\n");
+    int r = 0;
+    for (struct conn* p = lb_next(lb, NULL); p; p = lb_next(lb, p)) {
+        if (!full && r == RANK_TOP_N) {
+            sb_printf(&sb, "... 외 %d명 (!rank all)\n", lb->players - r);
+            break;
+        }
+        r++;
+        sb_printf(&sb, "%d위: %s (%d점)\n", r, p->nick, p->score);
+    }
+
+    msg_unref(*cache);
+    *cache = msg_tag(sb_to_msg(&sb), FR_BOARD);
+    *ver = lb->version;
+    return *cache ? msg_ref(*cache) : NULL;
+}
+
+// 입장 순 점수판. 순위표와 같은 version으로 캐시한다.
+struct msg* lb_score_board(struct leaderboard* lb, struct conn* members) {
+    if (lb->score_cache && lb->score_ver == lb->version) return msg_ref(lb->score_cache);
+
+    struct strbuf sb = { 0 };
+    sb_printf(&sb, "[점수판]\n");
+    int n = 0;
+    for (struct conn* p = members; p; p = p->next) {
+        if (n++ == SCORE_BOARD_MAX) {
+            sb_printf(&sb, "... 외 %d명\n", lb->players - SCORE_BOARD_MAX);
+            break;
+        }
+        sb_printf(&sb, "%s: %d점\n", p->nick, p->score);
+    }
+
+    msg_unref(lb->score_cache);
+    lb->score_cache = msg_tag(sb_to_msg(&sb), FR_BOARD);
+    lb->score_ver = lb->version;
+    return lb->score_cache ? msg_ref(lb->score_cache) : NULL;
+}
+
+// --- 방 ---
+// 방마다 퀴즈 상태, 출제 기록, 순위표, 참가자 목록을 따로 두므로 방송과
+// 순위 계산은 그 방 인원에만 비례한다. 방은 이름 해시로 찾는다.
+
+// 방 이름은 영문/숫자/_/- 만 허용한다. 출제 기록 파일의 구분자(\t)와 겹치지 않는다.
+int room_name_valid(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= ROOM_NAME_SIZE) return 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = name[i];
+        if (!isalnum(ch) && ch != '_' && ch != '-') return 0;
+    }
+    return 1;
+}
+
+// rooms_lock을 잡고 부른다.
+struct room* room_find(const char* name, size_t len) {
+    struct room* r = room_hash[hash_bytes(name, len) & (ROOM_HASH_SIZE - 1)];
+    for (; r; r = r->hash_next) {
+        if (strlen(r->name) == len && memcmp(r->name, name, len) == 0) return r;
+    }
+    return NULL;
+}
+
+// 쉬는 기록에서 이 방 이름의 기록을 되살린다. rooms_lock을 잡고 부른다.
+// 쉬는 기록 전체를 훑지만 방을 새로 만들 때만 한 번 한다.
+static void room_restore_history(struct room* r) {
+    size_t name_len = strlen(r->name);
+    struct word_set* ws = &history_idle;
+    for (size_t k = 0; k < ws->cap && ws->count; k++) {
+        struct word_entry* e = &ws->slots[k];
+        const char* text = ws->arena + e->off;
+        if (e->len > name_len + 1 && text[name_len] == '\t' && memcmp(text, r->name, name_len) == 0) {
+            word_set_put(&r->history, text + name_len + 1, e->len - name_len - 1, e->used_at);
+        }
+    }
+}
+
+// 이름으로 방을 찾고 없으면 만든다. 방이 너무 많으면 NULL.
+// 맡을 샤드는 이름 해시로 정하므로 어느 스레드에서 만들어도 같다.
+// 돌려준 방의 참조를 하나 잡아 두므로 들어가기 전에 없어지지 않는다. 참조는
+// conn_join으로 넘기거나 room_put으로 놓는다.
+struct room* room_get(const char* name, size_t len) {
+    if (len == 0 || len >= ROOM_NAME_SIZE) return NULL;
+    uint64_t h = hash_bytes(name, len);
+
+    pthread_mutex_lock(&rooms_lock);
+    struct room* r = room_find(name, len);
+    if (r == NULL && num_rooms < MAX_ROOMS && (r = calloc(1, sizeof(*r))) != NULL) {
+        memcpy(r->name, name, len);
+        r->name[len] = '\0';
+        r->shard = &shards[(h >> 32) % num_shards];
+        struct room** bucket = &room_hash[h & (ROOM_HASH_SIZE - 1)];
+        r->hash_next = *bucket;
+        *bucket = r;
+        rooms[num_rooms] = r;
+        __atomic_store_n(&num_rooms, num_rooms + 1, __ATOMIC_RELEASE);
+        room_restore_history(r);
+    }
+    if (r) r->refs++;
+    pthread_mutex_unlock(&rooms_lock);
+    return r;
+}
+
+void room_hold(struct room* r) {
+    pthread_mutex_lock(&rooms_lock);
+    r->refs++;
+    pthread_mutex_unlock(&rooms_lock);
+}
+
+// 참조도 퀴즈도 없으면 방을 표에서 빼고 출제 기록을 쉬는 기록으로 옮긴다.
+// rooms_lock을 잡고 부른다. 뺐으면 1.
+static int room_unlink_idle(struct room* r) {
+    if (r->refs > 0 || r->quiz_active) return 0;
+    struct room** pp = &room_hash[hash_bytes(r->name, strlen(r->name)) & (ROOM_HASH_SIZE - 1)];
+    while (*pp != r) pp = &(*pp)->hash_next;
+    *pp = r->hash_next;
+    int i = 0;
+    while (rooms[i] != r) i++;
+    memmove(&rooms[i], &rooms[i + 1], (num_rooms - i - 1) * sizeof(rooms[0]));
+    __atomic_store_n(&num_rooms, num_rooms - 1, __ATOMIC_RELEASE);
+
+    struct word_set* ws = &r->history;
+    size_t name_len = strlen(r->name);
+    for (size_t k = 0; k < ws->cap; k++) {
+        struct word_entry* e = &ws->slots[k];
+        if (e->len == 0 || name_len + 1 + e->len > 255) continue;
+        char text[255];
+        memcpy(text, r->name, name_len);
+        text[name_len] = '\t';
+        memcpy(text + name_len + 1, ws->arena + e->off, e->len);
+        word_set_put(&history_idle, text, name_len + 1 + e->len, e->used_at);
+    }
+    return 1;
+}
+
+// 표에서 뺀 방을 푼다. 순위표 캐시의 메시지 참조 수와 타이머는 맡은 샤드의
+// 것이라 그 샤드에서만 부른다.
+static void room_free(struct room* r) {
+    timer_del(&r->quiz_timer);
+    timer_del(&r->auto_timer);
+    msg_unref(r->lb.top_cache);
+    msg_unref(r->lb.full_cache);
+    msg_unref(r->lb.score_cache);
+    free(r->lb.buckets);
+    free(r->lb.tree);
+    free(r->history.slots);
+    free(r->history.arena);
+    free(r);
+}
+
+// 방이 비었으면 없앤다. 맡은 샤드에서 부른다.
+static void room_reap(struct room* r) {
+    pthread_mutex_lock(&rooms_lock);
+    int gone = room_unlink_idle(r);
+    pthread_mutex_unlock(&rooms_lock);
+    if (gone) room_free(r);
+}
+
+// room_get/room_hold로 잡은 참조를 놓는다. 다른 샤드의 방이면 그 샤드에
+// 넘겨서 놓게 한다.
+void room_put(struct room* r) {
+    if (r->shard != this_shard) {
+        shard_post_room(r->shard, r);
+        return;
+    }
+    pthread_mutex_lock(&rooms_lock);
+    r->refs--;
+    int gone = room_unlink_idle(r);
+    pthread_mutex_unlock(&rooms_lock);
+    if (gone) room_free(r);
+}
+
+void room_enter(struct room* r, struct conn* c) {
+    c->room = r;
+    c->score = score_load(r, c->nick);
+    lb_add(&r->lb, c);
+    c->prev = r->members_tail;
+    c->next = NULL;
+    if (r->members_tail) r->members_tail->next = c;
+    else r->members_head = c;
+    r->members_tail = c;
+    __atomic_fetch_add(&r->num_members, 1, __ATOMIC_RELAXED);
+
+    broadcast(r, NULL, msg_tag(msg_printf("👤 %s 님이 입장하였습니다.\n", c->nick), FR_ENTER));
+}
+
+// 방에서 빼고 남은 사람들에게 알린다. 점수는 방마다 따로 매긴다.
+void room_leave(struct conn* c, const char* how) {
+    struct room* r = c->room;
+    if (c->prev) c->prev->next = c->next;
+    else r->members_head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    else r->members_tail = c->prev;
+    c->prev = c->next = NULL;
+    __atomic_fetch_sub(&r->num_members, 1, __ATOMIC_RELAXED);
+    lb_remove(&r->lb, c);
+    c->room = NULL;
+
+    // 아무도 없는 방에 문제를 계속 내지 않는다.
+    if (r->num_members == 0 && r->auto_on) {
+        r->auto_on = 0;
+        timer_del(&r->auto_timer);
+    }
+
+    broadcast(r, NULL, msg_tag(msg_printf("👤 %s 님이 %s.\n", c->nick, how), FR_LEAVE));
+    room_put(r);
+}
+
+// 사람이 있는 방 목록. 현재 방은 비어 있지 않으므로 항상 나온다.
+// 다른 샤드의 방은 인원과 퀴즈 여부만 원자적으로 읽는다. 방이 없어지지 않도록
+// 훑는 동안 rooms_lock을 잡는다.
+struct msg* room_list(struct room* cur) {
+    struct strbuf sb = { 0 };
+    sb_printf(&sb, "[방 목록]\n");
+    int shown = 0, more = 0;
+    pthread_mutex_lock(&rooms_lock);
+    for (int i = 0; i < num_rooms; i++) {
+        struct room* r = rooms[i];
+        int members = __atomic_load_n(&r->num_members, __ATOMIC_RELAXED);
+        if (members == 0) continue;
+        if (shown == ROOM_LIST_MAX) {
+            more++;
+            continue;
+        }
+        shown++;
+        sb_printf(&sb, "%s (%d명)%s%s\n", r->name, members,
+            __atomic_load_n(&r->quiz_active, __ATOMIC_RELAXED) ? " 🧠퀴즈 진행 중" : "",
+            r == cur ? " ◀ 현재 방" : "");
+    }
+    pthread_mutex_unlock(&rooms_lock);
+    if (more) sb_printf(&sb, "... 외 %d개\n", more);
+    sb_printf(&sb, "방 이동/만들기: !join <방이름>\n");
+    return sb_to_msg(&sb);
+}
+
+// 드라이버는 화면을 큐에 넣고 바로 돌아오므로(O_NONBLOCK) 이벤트 루프가
+// LCD 전송을 기다리지 않는다. 아직 못 그린 같은/낮은 우선순위 화면은 덮인다.
+// msg는 '\n'으로 줄을 나누고, 줄마다 16글자에서 자르고 남는 칸은 공백으로 채운다.
+// 셀 버퍼를 매핑했으면 바뀐 칸만 고치고 그 구간을 FLUSH ioctl로 알린다.
+// 바뀐 칸이 없으면 시스템 콜도 없다.
+void send_to_lcd(const char* msg, enum lcd_prio prio) {
+    int lcd_fd = lcd_fds[prio];
+    if (lcd_fd == -1) {
+        fprintf(stderr, "LCD 장치가 열려 있지 않습니다. 메시지: '%s'\n", msg);
+        return;
+    }
+
+    char cells[LCD_ROWS][LCD_COLS];
+    memset(cells, ' ', sizeof(cells));
+    const char* p = msg;
+    for (int row = 0; row < LCD_ROWS && *p; row++) {
+        int col = 0;
+        for (; *p && *p != '\n'; p++) {
+            if (col < LCD_COLS) cells[row][col++] = *p;
+        }
+        if (*p == '\n') p++;
+    }
+
+    long long t0 = now_ns();
+    int ret = 0;
+    if (lcd_cells) {
+        char* fb = &lcd_cells[0][0];
+        const char* src = &cells[0][0];
+        int first = -1, last = -1;
+        pthread_mutex_lock(&lcd_lock);
+        for (int i = 0; i < LCD_CELLS; i++) {
+            if (fb[i] == src[i]) continue;
+            fb[i] = src[i];
+            if (first == -1) first = i;
+            last = i;
+        }
+        if (first != -1) {
+            struct lcd_region region = { .first = first, .count = last - first + 1 };
+            ret = ioctl(lcd_fd, LCD_IOC_FLUSH, &region);
+        }
+        pthread_mutex_unlock(&lcd_lock);
+    } else {
+        // 줄바꿈 없이 32칸을 보내면 드라이버가 16칸씩 두 줄로 편다.
+        ret = write(lcd_fd, cells, sizeof(cells)) == -1 ? -1 : 0;
+    }
+    // 샤드를 띄우기 전(시작 안내)에는 통계를 남길 곳이 없다.
+    if (this_shard) {
+        stat_hist_add(&this_shard->stats.lcd_ns, now_ns() - t0);
+        if (ret == -1) stat_add(&this_shard->stats.n.lcd_errors, 1);
+    }
+    if (ret == -1) {
+        perror("LCD 장치에 쓰기 실패");
+    }
+}
+
+// LCD 장치를 우선순위마다 한 번씩 연다. 우선순위 ioctl이 없는 예전 드라이버면
+// 모든 우선순위가 보통 fd 하나를 같이 쓴다.
+void lcd_open_all(void) {
+    lcd_fds[LCD_PRIO_NORMAL] = open(LCD_DEVICE_PATH, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (lcd_fds[LCD_PRIO_NORMAL] == -1) {
+        fprintf(stderr, "경고: '%s'를 열 수 없습니다. LCD 출력이 비활성화됩니다. (%s)\n", LCD_DEVICE_PATH, strerror(errno));
+        return;
+    }
+    for (int p = 0; p < LCD_PRIO_LEVELS; p++) {
+        if (p == LCD_PRIO_NORMAL) continue;
+        int fd = open(LCD_DEVICE_PATH, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd != -1 && ioctl(fd, LCD_IOC_SET_PRIO, p) == 0) {
+            lcd_fds[p] = fd;
+            continue;
+        }
+        fprintf(stderr, "경고: LCD 우선순위를 정할 수 없어 모든 화면을 같은 우선순위로 보냅니다. (%s)\n", strerror(errno));
+        if (fd != -1) close(fd);
+        for (p = 0; p < LCD_PRIO_LEVELS; p++) {
+            if (p != LCD_PRIO_NORMAL && lcd_fds[p] != -1) close(lcd_fds[p]);
+            lcd_fds[p] = lcd_fds[LCD_PRIO_NORMAL];
+        }
+        break;
+    }
+    // 셀 버퍼는 MAP_SHARED 쓰기라 읽기/쓰기로 연 fd가 필요하다. 매핑은 fd를
+    // 닫아도 남는다.
+    int fd = open(LCD_DEVICE_PATH, O_RDWR | O_CLOEXEC);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && S_ISCHR(st.st_mode)) {
+        void* cells = mmap(NULL, LCD_CELLS, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (cells != MAP_FAILED) lcd_cells = cells;
+    }
+    if (fd != -1) close(fd);
+}
+
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --- 통계 ---
+// 샤드마다 카운터와 히스토그램을 따로 두고, 값을 쌓는 쪽은 자기 샤드 것만
+// 건드린다. !stats와 관리 소켓(-A)은 읽을 때 모든 샤드를 더해 텍스트 또는
+// Prometheus 형식으로 내보낸다. 기록은 시계 읽기와 덧셈 몇 번뿐이라 부하
+// 중에도 켜 둔다.
+
+static int stat_index(uint64_t v) {
+    if (v < STAT_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v) - STAT_SUB_BITS;
+    return e * STAT_SUB + (int)(v >> e);
+}
+
+// 칸이 나타내는 구간의 아래 끝 값
+static uint64_t stat_value(int idx) {
+    if (idx < 2 * STAT_SUB) return idx;
+    int e = idx / STAT_SUB - 1;
+    return (uint64_t)(idx % STAT_SUB + STAT_SUB) << e;
+}
+
+void stat_hist_add(struct stat_hist* h, uint64_t v) {
+    stat_add(&h->count[stat_index(v)], 1);
+    stat_add(&h->total, 1);
+    stat_add(&h->sum, v);
+    if (v > h->max) __atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+static void stat_hist_merge(struct stat_hist* dst, const struct stat_hist* src) {
+    for (int i = 0; i < STAT_SLOTS; i++) {
+        dst->count[i] += __atomic_load_n(&src->count[i], __ATOMIC_RELAXED);
+    }
+    dst->total += __atomic_load_n(&src->total, __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if (max > dst->max) dst->max = max;
+}
+
+// 칸별 개수와 total을 따로 읽으므로 둘이 조금 어긋날 수 있다. 칸을 다 훑어도
+// 못 찾으면 최댓값을 쓴다.
+static uint64_t stat_percentile(const struct stat_hist* h, double p) {
+    if (h->total == 0) return 0;
+    uint64_t want = (uint64_t)(h->total * p);
+    if (want >= h->total) want = h->total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < STAT_SLOTS; i++) {
+        seen += h->count[i];
+        if (seen > want) return stat_value(i) < h->max ? stat_value(i) : h->max;
+    }
+    return h->max;
+}
+
+// 모든 샤드의 통계를 더한 사본을 만든다. 히스토그램이 커서 힙에 잡는다.
+static struct shard_stats* stats_collect(void) {
+    struct shard_stats* sum = calloc(1, sizeof(*sum));
+    if (sum == NULL) return NULL;
+    for (int i = 0; i < num_shards; i++) {
+        const struct shard_stats* st = &shards[i].stats;
+        const uint64_t* src = (const uint64_t*)&st->n;
+        uint64_t* dst = (uint64_t*)&sum->n;
+        for (size_t k = 0; k < sizeof(st->n) / sizeof(uint64_t); k++) {
+            dst[k] += __atomic_load_n(&src[k], __ATOMIC_RELAXED);
+        }
+        stat_hist_merge(&sum->loop_ns, &st->loop_ns);
+        for (int k = 0; k < CMD_KINDS; k++) stat_hist_merge(&sum->cmd_ns[k], &st->cmd_ns[k]);
+        stat_hist_merge(&sum->fanout, &st->fanout);
+        stat_hist_merge(&sum->outq, &st->outq);
+        stat_hist_merge(&sum->lcd_ns, &st->lcd_ns);
+    }
+    return sum;
+}
+
+static const char* const stat_cmd_names[CMD_KINDS] = { "quiz", "rank", "score", "guess", "chat", "other" };
+
+static void stats_text(struct strbuf* sb, const struct shard_stats* st) {
+    const struct stat_hist* h = &st->loop_ns;
+    sb_printf(sb, "📊 서버 통계 (%s, 스레드 %d개, 가동 %lld초)\n",
+        use_uring ? "io_uring" : "epoll", num_shards, (now_ms() - start_ms) / 1000);
+    sb_printf(sb, "접속 %d명 (연결 %d개), 방 %d개\n", __atomic_load_n(&num_clients, __ATOMIC_RELAXED),
+        __atomic_load_n(&num_conns, __ATOMIC_RELAXED), __atomic_load_n(&num_rooms, __ATOMIC_ACQUIRE));
+    sb_printf(sb, "루프 %llu회, 이벤트 %llu개, 한 바퀴 처리 p50 %.1fus / p99 %.1fus / 최대 %.1fus\n",
+        (unsigned long long)st->n.loops, (unsigned long long)st->n.events,
+        stat_percentile(h, 0.5) / 1e3, stat_percentile(h, 0.99) / 1e3, h->max / 1e3);
+    sb_printf(sb, "접속 수락 %llu회, 받은 바이트 %llu, 보낸 바이트 %llu\n", (unsigned long long)st->n.accepts,
+        (unsigned long long)st->n.bytes_in, (unsigned long long)st->n.bytes_out);
+    sb_printf(sb, "명령별 처리 시간 (건수, p50 / p99 / 최대):\n");
+    for (int k = 0; k < CMD_KINDS; k++) {
+        h = &st->cmd_ns[k];
+        if (h->total == 0) continue;
+        sb_printf(sb, "  %-6s %8llu건  %.1fus / %.1fus / %.1fus\n", stat_cmd_names[k], (unsigned long long)h->total,
+            stat_percentile(h, 0.5) / 1e3, stat_percentile(h, 0.99) / 1e3, h->max / 1e3);
+    }
+    h = &st->fanout;
+    sb_printf(sb, "브로드캐스트 %llu회, 수신자 평균 %.1f명 / p99 %llu명 / 최대 %llu명, 대기열에 넣은 바이트 %llu\n",
+        (unsigned long long)st->n.broadcasts, h->total ? (double)h->sum / h->total : 0.0,
+        (unsigned long long)stat_percentile(h, 0.99), (unsigned long long)h->max, (unsigned long long)st->n.fanout_bytes);
+    h = &st->outq;
+    sb_printf(sb, "송신 대기열 p50 %lluB / p99 %lluB / 최대 %lluB, 건너뛴 메시지 %llu개, 끊은 연결 %llu개\n",
+        (unsigned long long)stat_percentile(h, 0.5), (unsigned long long)stat_percentile(h, 0.99),
+        (unsigned long long)h->max, (unsigned long long)st->n.squashed, (unsigned long long)st->n.dropped);
+    h = &st->lcd_ns;
+    sb_printf(sb, "LCD 쓰기 %llu회, p50 %.1fus / p99 %.1fus / 최대 %.1fus, 실패 %llu회\n", (unsigned long long)h->total,
+        stat_percentile(h, 0.5) / 1e3, stat_percentile(h, 0.99) / 1e3, h->max / 1e3, (unsigned long long)st->n.lcd_errors);
+}
+
+static void prom_head(struct strbuf* sb, const char* name, const char* type, const char* help) {
+    sb_printf(sb, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// 히스토그램을 summary로 내보낸다. scale은 기록 단위를 Prometheus 단위로
+// 바꾸는 배율(나노초 → 초면 1e-9)이다.
+static void prom_summary(struct strbuf* sb, const char* name, const char* label, const struct stat_hist* h, double scale) {
+    static const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+    const char* sep = label ? "," : "";
+    if (label == NULL) label = "";
+    for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++) {
+        sb_printf(sb, "%s{%s%squantile=\"%g\"} %.9g\n", name, label, sep, qs[i], stat_percentile(h, qs[i]) * scale);
+    }
+    const char* open = *label ? "{" : "";
+    const char* close = *label ? "}" : "";
+    sb_printf(sb, "%s_sum%s%s%s %.9g\n", name, open, label, close, h->sum * scale);
+    sb_printf(sb, "%s_count%s%s%s %llu\n", name, open, label, close, (unsigned long long)h->total);
+}
+
+static void prom_value(struct strbuf* sb, const char* name, const char* type, const char* help, unsigned long long v) {
+    prom_head(sb, name, type, help);
+    sb_printf(sb, "%s %llu\n", name, v);
+}
+
+static void stats_prom(struct strbuf* sb, const struct shard_stats* st) {
+    prom_value(sb, "anagram_clients", "gauge", "Players that picked a nickname.", __atomic_load_n(&num_clients, __ATOMIC_RELAXED));
+    prom_value(sb, "anagram_connections", "gauge", "Open client connections.", __atomic_load_n(&num_conns, __ATOMIC_RELAXED));
+    prom_value(sb, "anagram_rooms", "gauge", "Rooms that currently exist.", __atomic_load_n(&num_rooms, __ATOMIC_ACQUIRE));
+    prom_value(sb, "anagram_uptime_seconds", "gauge", "Seconds since the server started.", (now_ms() - start_ms) / 1000);
+
+    prom_head(sb, "anagram_loop_iterations_total", "counter", "Event loop iterations per reactor thread.");
+    for (int i = 0; i < num_shards; i++) {
+        sb_printf(sb, "anagram_loop_iterations_total{shard=\"%d\"} %llu\n", i,
+            (unsigned long long)__atomic_load_n(&shards[i].stats.n.loops, __ATOMIC_RELAXED));
+    }
+    prom_value(sb, "anagram_events_total", "counter", "epoll events or io_uring completions handled.", st->n.events);
+    prom_value(sb, "anagram_accepts_total", "counter", "Accepted client connections.", st->n.accepts);
+    prom_value(sb, "anagram_received_bytes_total", "counter", "Bytes read from clients.", st->n.bytes_in);
+    prom_value(sb, "anagram_sent_bytes_total", "counter", "Bytes written to clients.", st->n.bytes_out);
+    prom_value(sb, "anagram_broadcasts_total", "counter", "Room broadcasts.", st->n.broadcasts);
+    prom_value(sb, "anagram_broadcast_bytes_total", "counter", "Bytes queued by broadcasts (body times recipients).", st->n.fanout_bytes);
+    prom_value(sb, "anagram_outq_squashed_total", "counter", "Queued messages discarded for slow clients.", st->n.squashed);
+    prom_value(sb, "anagram_outq_dropped_total", "counter", "Slow clients disconnected by the drop policy.", st->n.dropped);
+    prom_value(sb, "anagram_lcd_errors_total", "counter", "Failed LCD writes.", st->n.lcd_errors);
+
+    prom_head(sb, "anagram_loop_seconds", "summary", "Work time of one event loop iteration, excluding the wait.");
+    prom_summary(sb, "anagram_loop_seconds", NULL, &st->loop_ns, 1e-9);
+    prom_head(sb, "anagram_command_seconds", "summary", "Time to handle one client line.");
+    for (int k = 0; k < CMD_KINDS; k++) {
+        char label[32];
+        snprintf(label, sizeof(label), "cmd=\"%s\"", stat_cmd_names[k]);
+        prom_summary(sb, "anagram_command_seconds", label, &st->cmd_ns[k], 1e-9);
+    }
+    prom_head(sb, "anagram_broadcast_fanout", "summary", "Recipients of one broadcast.");
+    prom_summary(sb, "anagram_broadcast_fanout", NULL, &st->fanout, 1);
+    prom_head(sb, "anagram_outq_bytes", "summary", "Send queue depth in bytes right after queueing a message.");
+    prom_summary(sb, "anagram_outq_bytes", NULL, &st->outq, 1);
+    prom_head(sb, "anagram_lcd_write_seconds", "summary", "Time spent in the LCD device write or flush ioctl.");
+    prom_summary(sb, "anagram_lcd_write_seconds", NULL, &st->lcd_ns, 1e-9);
+}
+
+// 모든 샤드를 더한 통계를 sb에 붙인다. prom이면 Prometheus 텍스트 형식이다.
+void stats_format(struct strbuf* sb, int prom) {
+    struct shard_stats* st = stats_collect();
+    if (st == NULL) {
+        sb_printf(sb, prom ? "# out of memory\n" : "통계를 모으지 못했습니다.\n");
+        return;
+    }
+    if (prom) stats_prom(sb, st);
+    else stats_text(sb, st);
+    free(st);
+}
+
+// 관리 소켓 요청 하나에 답한다. 첫 줄이 "text"면 !stats와 같은 텍스트,
+// "GET "으로 시작하면 HTTP 응답(curl --unix-socket, Prometheus 수집용),
+// 그 밖이나 아무것도 보내지 않으면 Prometheus 텍스트를 보내고 닫는다.
+static void admin_serve(int fd) {
+    struct timeval tv = { .tv_sec = 0, .tv_usec = ADMIN_READ_MS * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char req[256];
+    ssize_t n = recv(fd, req, sizeof(req) - 1, 0);
+    req[n > 0 ? n : 0] = '\0';
+
+    int http = strncmp(req, "GET ", 4) == 0;
+    struct strbuf body = { 0 };
+    stats_format(&body, strncmp(req, "text", 4) != 0);
+
+    struct strbuf out = { 0 };
+    if (http) {
+        sb_printf(&out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.len);
+    }
+    struct iovec iov[2] = {
+        { out.data, out.len },
+        { body.data, body.len },
+    };
+    int cnt = 2, i = 0;
+    while (i < cnt) {
+        ssize_t w = writev(fd, iov + i, cnt - i);
+        if (w == -1 && errno == EINTR) continue;
+        if (w <= 0) break;
+        for (; i < cnt && (size_t)w >= iov[i].iov_len; i++) w -= iov[i].iov_len;
+        if (i < cnt) {
+            iov[i].iov_base = (char*)iov[i].iov_base + w;
+            iov[i].iov_len -= w;
+        }
+    }
+    free(out.data);
+    free(body.data);
+}
+
+// 관리 소켓은 이벤트 루프와 따로 도는 스레드 하나가 한 번에 한 요청씩 받는다.
+static void* admin_main(void* arg) {
+    int lfd = (int)(intptr_t)arg;
+    while (1) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("관리 소켓 accept() 실패");
+            break;
+        }
+        admin_serve(fd);
+        close(fd);
+    }
+    close(lfd);
+    return NULL;
+}
+
+// -A 경로에 관리용 Unix 소켓을 연다. 이전 실행이 남긴 소켓 파일은 지우지만,
+// 소켓이 아닌 파일은 건드리지 않는다.
+void admin_open(const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "경고: 관리 소켓 경로가 너무 깁니다: %s\n", path);
+        return;
+    }
+    strcpy(addr.sun_path, path);
+
+    struct stat stbuf;
+    if (lstat(path, &stbuf) == 0) {
+        if (!S_ISSOCK(stbuf.st_mode)) {
+            fprintf(stderr, "경고: '%s'가 소켓이 아니라서 관리 소켓을 열지 않습니다.\n", path);
+            return;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("관리 소켓 socket() 실패");
+        return;
+    }
+    // 통계에는 접속자 수 같은 운영 정보가 있으므로 소유자만 접근하게 한다.
+    mode_t old = umask(0077);
+    int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old);
+    if (rc == -1 || listen(fd, 16) == -1) {
+        fprintf(stderr, "경고: 관리 소켓 '%s'를 열 수 없습니다. (%s)\n", path, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, admin_main, (void*)(intptr_t)fd) != 0) {
+        fprintf(stderr, "경고: 관리 소켓 스레드를 만들 수 없습니다.\n");
+        close(fd);
+        return;
+    }
+    pthread_detach(th);
+    printf("관리 소켓 '%s' 열림.\n", path);
+}
+
+// --- 샤드 ---
+// 리액터 스레드마다 epoll, SO_REUSEPORT 리스너, 타이머 휠, 우편함을 따로 둔다.
+// 방은 이름 해시로 한 샤드에 고정되고, 연결은 들어간 방의 샤드가 가진다.
+// 다른 샤드로 가는 연결과 전체 공지는 우편함(MPSC 큐)으로만 넘기므로
+// 방과 연결 상태에는 잠금이 없다.
+
+static void mailbox_init(struct mailbox* mb) {
+    mb->stub.next = NULL;
+    mb->head = mb->tail = &mb->stub;
+    mb->pending = 0;
+}
+
+// 여러 생산자가 동시에 넣을 수 있다. 교환 한 번과 저장 한 번으로 끝난다.
+static void mailbox_push(struct mailbox* mb, struct mail* m) {
+    __atomic_store_n(&m->next, NULL, __ATOMIC_RELAXED);
+    struct mail* prev = __atomic_exchange_n(&mb->head, m, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, m, __ATOMIC_RELEASE);
+}
+
+// 생산자가 head를 바꾸고 next를 잇기 전이면 잠깐 기다린다.
+static struct mail* mail_next(struct mail* m) {
+    struct mail* next;
+    while ((next = __atomic_load_n(&m->next, __ATOMIC_ACQUIRE)) == NULL) {
+        sched_yield();
+    }
+    return next;
+}
+
+// 소비자(샤드 스레드)만 부른다. 비어 있으면 NULL.
+static struct mail* mailbox_pop(struct mailbox* mb) {
+    struct mail* tail = mb->tail;
+    if (tail == &mb->stub) {
+        if (__atomic_load_n(&mb->head, __ATOMIC_ACQUIRE) == tail) return NULL;
+        tail = mb->tail = mail_next(tail);
+    }
+    // 마지막 항목이면 stub을 뒤에 붙여야 떼어 낼 수 있다.
+    if (__atomic_load_n(&mb->head, __ATOMIC_ACQUIRE) == tail) {
+        mailbox_push(mb, &mb->stub);
+    }
+    mb->tail = mail_next(tail);
+    return tail;
+}
+
+// 다른 샤드에 일을 넘긴다. 잠든 샤드만 eventfd로 깨운다.
+void shard_post(struct shard* s, enum mail_kind kind, struct conn* c, struct msg* m) {
+    struct mail* mail = malloc(sizeof(*mail));
+    if (mail == NULL) {
+        msg_unref(m);
+        return;
+    }
+    mail->kind = kind;
+    mail->c = c;
+    mail->m = m;
+    mail->r = NULL;
+    shard_deliver(s, mail);
+}
+
+// 방 참조를 맡은 샤드에 넘겨서 놓게 한다. 할당에 실패하면 방이 남을 뿐이다.
+void shard_post_room(struct shard* s, struct room* r) {
+    struct mail* mail = calloc(1, sizeof(*mail));
+    if (mail == NULL) return;
+    mail->kind = MAIL_ROOM_PUT;
+    mail->r = r;
+    shard_deliver(s, mail);
+}
+
+static void shard_deliver(struct shard* s, struct mail* mail) {
+    mailbox_push(&s->mail, mail);
+    if (__atomic_exchange_n(&s->mail.pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        uint64_t one = 1;
+        if (write(s->mail_handle.fd, &one, sizeof(one)) == -1) perror("샤드 깨우기 실패");
+    }
+}
+
+// 이 샤드가 가진 모든 방에 보낸다. 넘겨받은 참조는 여기서 놓는다.
+static void announce_local(struct msg* m) {
+    // 보내다가 연결이 닫히면 room_put이 rooms_lock을 잡으므로, 방을 참조로
+    // 붙잡아 모은 뒤 잠금을 풀고 보낸다.
+    struct room* local[MAX_ROOMS];
+    int n = 0;
+    pthread_mutex_lock(&rooms_lock);
+    for (int i = 0; i < num_rooms; i++) {
+        struct room* r = rooms[i];
+        if (r->shard == this_shard && r->members_head) {
+            r->refs++;
+            local[n++] = r;
+        }
+    }
+    pthread_mutex_unlock(&rooms_lock);
+    for (int i = 0; i < n; i++) {
+        broadcast(local[i], NULL, msg_ref(m));
+        room_put(local[i]);
+    }
+    msg_unref(m);
+}
+
+// 모든 샤드에 공지한다. 메시지 참조 수는 샤드 안에서만 바뀌므로 샤드마다
+// 따로 만든다.
+void announce_all(struct msg* m) {
+    if (m == NULL) return;
+    for (int i = 0; i < num_shards; i++) {
+        if (&shards[i] == this_shard) continue;
+        shard_post(&shards[i], MAIL_ANNOUNCE, NULL, msg_copy(m));
+    }
+    announce_local(m);
+}
+
+// 다른 샤드로 넘어간 연결을 받아 방에 넣는다.
+static void adopt_conn(struct conn* c) {
+    if (conn_watch(c) == -1) {
+        perror("연결 인수 실패");
+        close_conn(c);
+        return;
+    }
+    c->state = ACTIVE;
+    if (idle_timeout_ms > 0) timer_add(&c->timer, idle_timeout_ms, conn_timeout);
+    room_enter(c->room, c);
+    // 이전 샤드가 받아만 두고 처리하지 않은 줄이 있을 수 있다.
+    process_input(c);
+    // 넘어오기 전에 쌓인 송신 대기열도 이 샤드에서 이어서 보낸다.
+    if (conn_flush(c) == -1) mark_dead(c);
+}
+
+void drain_mailbox(void) {
+    uint64_t cnt;
+    while (read(this_shard->mail_handle.fd, &cnt, sizeof(cnt)) > 0) {
+    }
+    __atomic_exchange_n(&this_shard->mail.pending, 0, __ATOMIC_ACQ_REL);
+
+    struct mail* mail;
+    while ((mail = mailbox_pop(&this_shard->mail)) != NULL) {
+        if (mail->kind == MAIL_ADOPT) adopt_conn(mail->c);
+        else if (mail->kind == MAIL_ROOM_PUT) room_put(mail->r);
+        else announce_local(mail->m);
+        free(mail);
+    }
+}
+
+// 방에 넣는다. 방이 다른 샤드에 있으면 이번 루프가 끝날 때 넘긴다.
+// 호출자가 잡은 방 참조는 참가자의 참조가 된다.
+void conn_join(struct conn* c, struct room* r) {
+    if (r->shard == this_shard) {
+        room_enter(r, c);
+        return;
+    }
+    c->state = MIGRATING;
+    c->room = r;
+    c->move_next = this_shard->move_list;
+    this_shard->move_list = c;
+}
+
+// 메시지 참조 수는 샤드 안에서만 세므로 넘기기 전에 대기열을 사본으로 바꾼다.
+static void outq_privatize(struct outq* q) {
+    for (unsigned k = q->head; k != q->tail; k++) {
+        struct msg** slot = &q->slot[k & (OUTQ_SLOTS - 1)];
+        struct msg* copy = msg_copy(*slot);
+        if (copy == NULL) continue;
+        msg_unref(*slot);
+        *slot = copy;
+    }
+}
+
+// 루프 끝에서 옮길 연결을 넘긴다. 넘긴 뒤에는 이 스레드가 c를 만지지 않는다.
+void flush_moves(void) {
+    while (this_shard->move_list) {
+        struct conn* c = this_shard->move_list;
+        this_shard->move_list = c->move_next;
+        if (c->state != MIGRATING) continue; // 그 사이 닫힘
+
+        timer_del(&c->timer);
+        if (use_uring) {
+            // 걸린 recv/send가 끝나면 uring_release가 다시 목록에 올린다.
+            if (uring_detach(c)) continue;
+        }
+        else {
+            epoll_ctl(this_shard->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        }
+        outq_privatize(&c->out);
+        shard_post(c->room->shard, MAIL_ADOPT, c, NULL);
+    }
+}
+
+// 연결을 이 샤드의 이벤트 루프에 등록한다. epoll이면 엣지 트리거로 걸고,
+// io_uring이면 멀티샷 recv를 건다.
+int conn_watch(struct conn* c) {
+    if (use_uring) {
+        uring_recv(c);
+        return 0;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = c->fd;
+    return epoll_ctl(this_shard->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+// 새로 받은 소켓을 연결로 등록하고 닉네임을 묻는다.
+// epoll과 io_uring accept가 모두 여기로 온다.
+static void conn_accepted(int clnt_sock) {
+    stat_add(&this_shard->stats.n.accepts, 1);
+    // 송신 대기열은 루프마다 모아서 한 번에 보내므로 Nagle로 더 묶을 것이 없다.
+    // 켜 두면 작은 프레임이 상대의 지연 ACK(약 40ms)를 기다린다.
+    int one = 1;
+    setsockopt(clnt_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (__atomic_add_fetch(&num_conns, 1, __ATOMIC_RELAXED) > max_clients) {
+        __atomic_fetch_sub(&num_conns, 1, __ATOMIC_RELAXED);
+        char* msg = "서버가 꽉 찼습니다.\n";
+        write(clnt_sock, msg, strlen(msg));
+        close(clnt_sock);
+        return;
+    }
+
+    struct conn* c = conn_alloc(clnt_sock);
+    if (c == NULL) {
+        __atomic_fetch_sub(&num_conns, 1, __ATOMIC_RELAXED);
+        close(clnt_sock);
+        return;
+    }
+    c->kind = H_CLIENT;
+    c->state = AWAITING_NICK;
+
+    if (conn_watch(c) == -1) {
+        perror("클라이언트 등록 실패");
+        c->state = CLOSING;
+        close_conn_fd(c);
+        return;
+    }
+
+    c->last_active = now_ms();
+    timer_add(&c->timer, nick_timeout_ms, conn_timeout);
+
+    send_typed(c, FR_PROMPT, "닉네임을 입력하세요: ");
+}
+
+// 한 번에 최대 ACCEPT_BATCH개까지 받는다. 남은 연결이 있으면 accept_pending을
+// 세워 다음 루프에서 다른 클라이언트 이벤트와 번갈아 처리한다.
+void accept_clients(void) {
+    struct sockaddr_in clnt_addr;
+    socklen_t clnt_addr_size;
+
+    this_shard->accept_pending = 0;
+    for (int n = 0; n < ACCEPT_BATCH; n++) {
+        clnt_addr_size = sizeof(clnt_addr);
+        int clnt_sock = accept4(this_shard->listener.fd, (struct sockaddr*)&clnt_addr, &clnt_addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clnt_sock == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept() 실패");
+            return;
+        }
+        conn_accepted(clnt_sock);
+    }
+    this_shard->accept_pending = 1;
+}
+
+// 닉네임 입력이 끝난 연결을 게임에 참여시킨다.
+void activate_client(struct conn* c) {
+    c->state = ACTIVE;
+    if (idle_timeout_ms > 0) timer_add(&c->timer, idle_timeout_ms, conn_timeout);
+    else timer_del(&c->timer);
+
+    int players = __atomic_add_fetch(&num_clients, 1, __ATOMIC_RELAXED);
+    // 같이 접속한 사람들이 같은 방에서 만나도록 로비는 하나다. 로비가 다른
+    // 샤드에 있으면 이 연결은 MAIL_ADOPT로 로비의 샤드로 옮겨 간다.
+    room_hold(lobby);
+    conn_join(c, lobby);
+    printf("연결됨: %s\n", c->nick);
+
+    char lcd_player_msg[LCD_MSG_LEN];
+    snprintf(lcd_player_msg, sizeof(lcd_player_msg), "Players: %d", players);
+    send_to_lcd(lcd_player_msg, LCD_PRIO_LOW);
+}
+
+// 연결을 CLOSING 상태로 바꾸고 소켓을 닫는다. 객체는 이벤트 배치 처리가
+// 끝난 뒤 reap_closed()에서 해제하므로 호출 직후에도 c를 읽을 수 있다.
+// 닫기 전에 남은 송신 데이터(작별 메시지 등)를 한 번 더 보내본다.
+void close_conn(struct conn* c) {
+    if (c->state == CLOSING) return;
+
+    timer_del(&c->timer);
+    if (c->state == ACTIVE || c->state == MIGRATING) {
+        printf("연결 종료: %s\n", c->nick);
+
+        // 다른 샤드로 가던 연결은 아직 어느 방에도 없고 참조만 쥐고 있다.
+        if (c->state == ACTIVE) room_leave(c, "나갔습니다");
+        else room_put(c->room);
+        int players = __atomic_sub_fetch(&num_clients, 1, __ATOMIC_RELAXED);
+
+        char lcd_player_msg[LCD_MSG_LEN];
+        snprintf(lcd_player_msg, sizeof(lcd_player_msg), "Players: %d", players);
+        send_to_lcd(lcd_player_msg, LCD_PRIO_LOW);
+    }
+
+    // io_uring이 보내는 중인 메시지는 그 완료 때 푼다.
+    if (!c->dead && !c->out.inflight) conn_writev(c);
+    if (!c->out.inflight) outq_free_all(&c->out);
+    c->state = CLOSING;
+    if (!use_uring) epoll_ctl(this_shard->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close_conn_fd(c);
+}
+
+// 소켓을 닫고 slab 칸을 이 샤드의 해제 목록에 올린다. io_uring에 걸린
+// recv/send는 fd를 닫아도 끝나지 않으므로 shutdown으로 끝내고, 칸은 마지막
+// 완료가 왔을 때 uring_release가 올린다.
+void close_conn_fd(struct conn* c) {
+    int busy = c->recv_armed || c->out.inflight;
+    fd_table[c->fd] = NULL;
+    if (busy) shutdown(c->fd, SHUT_RDWR);
+    close(c->fd);
+    __atomic_fetch_sub(&num_conns, 1, __ATOMIC_RELAXED);
+    if (busy) return;
+    c->close_next = this_shard->close_list;
+    this_shard->close_list = c;
+}
+
+void reap_closed(void) {
+    if (this_shard->close_list == NULL) return;
+    pthread_mutex_lock(&slab_lock);
+    while (this_shard->close_list) {
+        struct conn* c = this_shard->close_list;
+        this_shard->close_list = c->close_next;
+        free_slots[free_top++] = c->slot;
+    }
+    pthread_mutex_unlock(&slab_lock);
+}
+
+// 연결 타이머 만료: 닉네임 대기 중이면 제한 시간 초과, 참여 중이면 유휴 검사.
+// 입력마다 타이머를 옮기지 않고 last_active만 갱신해 두었다가 여기서 남은
+// 시간만큼 다시 건다.
+void conn_timeout(struct timer* t) {
+    struct conn* c = container_of(t, struct conn, timer);
+    if (c->state == AWAITING_NICK) {
+        send_str(c, "닉네임 입력 시간이 초과되었습니다.\n");
+        mark_dead(c);
+        return;
+    }
+    if (c->state != ACTIVE || idle_timeout_ms <= 0) return;
+
+    long long idle = now_ms() - c->last_active;
+    if (idle < idle_timeout_ms) {
+        timer_add(&c->timer, idle_timeout_ms - idle, conn_timeout);
+        return;
+    }
+    send_str(c, "장시간 입력이 없어 연결을 종료합니다.\n");
+    mark_dead(c);
+}
+
+// 퀴즈 제한 시간이 지나면 방에 정답을 알리고 끝낸다.
+void quiz_timeout(struct timer* t) {
+    struct room* r = container_of(t, struct room, quiz_timer);
+    if (!r->quiz_active) return;
+
+    broadcast(r, NULL, msg_tag(msg_printf("⏰ 퀴즈 제한 시간 초과! 정답은: %s%s%s\n",
+        YELLOW, r->current_answer, RESET), FR_TIMEOUT));
+
+    // 사전은 음절 구성으로만 찾을 수 있어서, 자모 구성으로 정답을 받는
+    // 퀴즈에서는 실제로 받은 답과 달라지므로 다른 정답을 보여 주지 않는다.
+    const char* alt[ALT_ANSWERS_SHOWN];
+    int n = r->answer_jamo ? 0 : dict_anagrams(r->answer_key, r->answer_len, r->answer_sig, alt, ALT_ANSWERS_SHOWN);
+    if (n > 0) {
+        struct strbuf sb = { 0 };
+        sb_printf(&sb, "   다른 정답:");
+        for (int i = 0; i < n && i < ALT_ANSWERS_SHOWN; i++) {
+            sb_printf(&sb, " %s", alt[i]);
+        }
+        if (n > ALT_ANSWERS_SHOWN) sb_printf(&sb, " 외 %d개", n - ALT_ANSWERS_SHOWN);
+        sb_printf(&sb, "\n");
+        broadcast(r, NULL, msg_tag(sb_to_msg(&sb), FR_TIMEOUT));
+    }
+
+    char lcd_timeout_msg[LCD_MSG_LEN];
+    snprintf(lcd_timeout_msg, sizeof(lcd_timeout_msg), "Time's Up!\nAns: %.11s", r->current_answer);
+    send_to_lcd(lcd_timeout_msg, LCD_PRIO_HIGH);
+
+    quiz_end(r);
+}
+
+// 퀴즈를 시작한다. setter가 NULL이면 자동 출제다. jamo이면 한글 음절을
+// 자모로 풀어서 섞고, 정답도 자모 구성으로 비교한다.
+void quiz_start(struct room* r, const char* word, const char* key, size_t key_len, uint64_t sig, int jamo, struct conn* setter) {
+    time_t now = time(NULL);
+    snprintf(r->current_answer, sizeof(r->current_answer), "%s", word);
+    memcpy(r->answer_key, key, key_len);
+    r->answer_key[key_len] = '\0';
+    r->answer_len = key_len;
+    r->answer_sig = sig;
+    r->answer_chars = utf8_count(key, key_len);
+
+    uint32_t units[QUIZ_MAX_UNITS];
+    int n = word_units(key, key_len, jamo, units, QUIZ_MAX_UNITS);
+    // 한글 음절이 없으면 자모로 풀어도 달라지지 않는다.
+    r->answer_jamo = jamo && n > r->answer_chars;
+    hist_build(&r->answer_hist, units, n > 0 ? n : 0);
+    if (word_set_put(&r->history, key, key_len, now) == 0) {
+        history_append(r, key, key_len, now);
+    }
+
+    char quiz_shuffled[SHUFFLED_SIZE];
+    shuffle(r->current_answer, r->answer_jamo, quiz_shuffled);
+    // 섞은 글자가 그대로 정답이 되지 않도록 몇 번 다시 섞는다.
+    for (int tries = 0; tries < 8 && answer_accepted(r, quiz_shuffled); tries++) {
+        shuffle(r->current_answer, r->answer_jamo, quiz_shuffled);
+    }
+    const char* hint = r->answer_jamo ? ", 자모 분해" : "";
+    if (setter) {
+        broadcast(r, NULL, msg_tag(msg_printf("🧠 [퀴즈] %s 님이 문제 출제: %s (%d글자%s)\n",
+            setter->nick, quiz_shuffled, r->answer_chars, hint), FR_QUIZ));
+    }
+    else {
+        broadcast(r, NULL, msg_tag(msg_printf("🧠 [자동 퀴즈·%s] 문제: %s (%d글자%s)\n",
+            tier_names[r->auto_tier], quiz_shuffled, r->answer_chars, hint), FR_QUIZ));
+    }
+    __atomic_store_n(&r->quiz_active, 1, __ATOMIC_RELAXED);
+    timer_add(&r->quiz_timer, QUIZ_TIME_LIMIT * 1000, quiz_timeout);
+
+    int alt = dict_anagrams(key, key_len, sig, NULL, 0);
+    if (alt > 0 && setter) {
+        struct msg* m = msg_printf("ℹ️ 같은 글자로 된 사전 단어 %d개도 정답으로 인정됩니다.\n", alt);
+        conn_send(setter, m);
+        msg_unref(m);
+    }
+
+    char lcd_quiz_msg[LCD_MSG_LEN];
+    snprintf(lcd_quiz_msg, sizeof(lcd_quiz_msg), "QUIZ:%.11s\n%.16s", word, quiz_shuffled);
+    send_to_lcd(lcd_quiz_msg, LCD_PRIO_HIGH);
+}
+
+// 퀴즈를 끝낸다. 자동 출제 중이면 잠시 뒤 다음 문제를 낸다.
+// 아무도 없는 방이면 없애므로 부른 뒤에는 r을 쓰지 않는다.
+void quiz_end(struct room* r) {
+    __atomic_store_n(&r->quiz_active, 0, __ATOMIC_RELAXED);
+    timer_del(&r->quiz_timer);
+    r->current_answer[0] = '\0';
+    if (r->auto_on) timer_add(&r->auto_timer, AUTO_QUIZ_DELAY_MS, auto_quiz);
+    room_reap(r);
+}
+
+// 정규화한 추측이 출제 단어와 같거나, 사전에 있는 같은 글자 구성의 단어면
+// 정답이다. 사전이 없어도 같은 정규화를 거치므로 -d 여부와 상관없이 대소문자와
+// 앞뒤 공백은 가리지 않는다. 추측은 스택에서 한 번 풀어 정답 히스토그램과
+// 비교하므로 할당이 없고, 사전 확인도 단어 길이에 비례하는 해시 계산과 표
+// 조회뿐이다.
+int answer_accepted(struct room* r, const char* guess) {
+    char key[QUIZ_WORD_SIZE];
+    size_t len = normalize_word(guess, key, sizeof(key));
+    if (len == r->answer_len && memcmp(key, r->answer_key, len) == 0) return 1;
+    if (dict.count == 0) return 0;
+
+    uint32_t units[QUIZ_MAX_UNITS];
+    int n = word_units(key, len, r->answer_jamo, units, QUIZ_MAX_UNITS);
+    if (n < 0 || !hist_match(&r->answer_hist, units, n)) return 0;
+    return dict_contains(key, len);
+}
+
+// 닉네임 대기 중에 받은 한 줄을 닉네임으로 확정한다.
+void set_nick(struct conn* c, const char* line) {
+    if (*line == '\0') {
+        send_typed(c, FR_PROMPT, "닉네임을 입력하세요: ");
+        return;
+    }
+    snprintf(c->nick, sizeof(c->nick), "%s", line);
+    activate_client(c);
+}
+
+// 완성된 줄(끝의 \r\n 제거됨)을 연결 상태에 맞게 처리한다.
+void dispatch_line(struct conn* c, char* line) {
+    if (c->state == AWAITING_NICK && !c->framed && strcmp(line, PROTO_HELLO) == 0) start_framing(c);
+    else if (c->state == AWAITING_NICK) set_nick(c, line);
+    else if (c->state == ACTIVE) {
+        long long t0 = now_ns();
+        enum stat_cmd kind = handle_message(c, line);
+        stat_hist_add(&this_shard->stats.cmd_ns[kind], now_ns() - t0);
+    }
+}
+
+// 입력을 처리할 상태인지. 다른 샤드로 넘어가는 연결은 남은 입력을
+// 새 샤드가 이어서 처리한다.
+static int conn_reading(struct conn* c) {
+    return c->state == AWAITING_NICK || c->state == ACTIVE;
+}
+
+// 프레임 프로토콜로 바꾼다. 그 전에 텍스트로 보낸 안내문은 다 내보내야
+// 스트림이 섞이지 않으므로, 못 보냈으면 연결을 끊는다. io_uring이 보내는
+// 중이면 대기열 전부가 이미 텍스트로 나가고 있어야 한다.
+void start_framing(struct conn* c) {
+    struct outq* q = &c->out;
+    int unsent = q->inflight ? q->tail - q->head != q->inflight : conn_writev(c) != 0;
+    if (unsent) {
+        mark_dead(c);
+        return;
+    }
+    c->framed = 1;
+    send_typed(c, FR_HELLO, PROTO_NAME);
+    send_typed(c, FR_PROMPT, "닉네임을 입력하세요: ");
+}
+
+// 입력 링 버퍼에서 프레임 단위로 잘라 처리한다. 헤더나 본문이 덜 왔으면
+// 다음 수신을 기다린다. 프레임은 MAX_LINE_LEN을 넘지 않으므로 링이 차지 않는다.
+static void process_frames(struct conn* c) {
+    struct inbuf* in = &c->in;
+    char line[MAX_LINE_LEN + 1];
+
+    while (conn_reading(c) && in->head != in->tail) {
+        uint8_t hdr[FRAME_HDR_MAX];
+        unsigned avail = in->tail - in->head;
+        unsigned n = avail < FRAME_HDR_MAX ? avail : FRAME_HDR_MAX;
+        for (unsigned k = 0; k < n; k++) {
+            hdr[k] = in->data[(in->head + k) & (INBUF_SIZE - 1)];
+        }
+        uint8_t type;
+        uint32_t len;
+        int h = frame_parse(hdr, n, &type, &len);
+        if (h == 0) return;
+        if (h < 0 || len > MAX_LINE_LEN) {
+            send_typed(c, FR_ERROR, "잘못된 프레임입니다. 연결을 종료합니다.\n");
+            in->head = in->scan = in->tail;
+            mark_dead(c);
+            return;
+        }
+        if (avail < h + len) return;
+
+        for (unsigned k = 0; k < len; k++) {
+            line[k] = in->data[(in->head + h + k) & (INBUF_SIZE - 1)];
+        }
+        line[len] = '\0';
+        in->head += h + len;
+        in->scan = in->head;
+        // 모르는 종류는 건너뛴다.
+        if (type == FR_LINE) dispatch_line(c, line);
+    }
+}
+
+// 입력 링 버퍼에서 줄바꿈 단위로 명령을 잘라 처리한다. 이미 검사한 구간은
+// scan 위치로 건너뛰므로 한 줄이 여러 세그먼트에 나뉘어 와도 다시 훑지 않는다.
+void process_input(struct conn* c) {
+    struct inbuf* in = &c->in;
+    char line[MAX_LINE_LEN + 1];
+
+    while (conn_reading(c) && in->scan != in->tail) {
+        if (c->framed) {
+            process_frames(c);
+            return;
+        }
+        if (in->data[in->scan & (INBUF_SIZE - 1)] != '\n') {
+            in->scan++;
+            if (in->scan - in->head > MAX_LINE_LEN) {
+                // 줄이 너무 길면 다음 줄바꿈까지 버린다.
+                if (!in->discarding) {
+                    send_typed(c, FR_ERROR, "메시지가 너무 깁니다. 무시합니다.\n");
+                }
+                in->discarding = 1;
+                in->head = in->scan;
+            }
+            continue;
+        }
+
+        unsigned len = in->scan - in->head;
+        in->scan++;
+        if (in->discarding) {
+            in->discarding = 0;
+            in->head = in->scan;
+            continue;
+        }
+
+        for (unsigned k = 0; k < len; k++) {
+            line[k] = in->data[(in->head + k) & (INBUF_SIZE - 1)];
+        }
+        if (len > 0 && line[len - 1] == '\r') len--;
+        line[len] = '\0';
+        in->head = in->scan;
+        dispatch_line(c, line);
+    }
+}
+
+// 상대가 연결을 끊었다. 줄바꿈 없이 끝난 마지막 명령도 처리하고 닫는다.
+static void conn_eof(struct conn* c) {
+    struct inbuf* in = &c->in;
+    if (conn_reading(c) && in->tail != in->head && !in->discarding && !c->framed) {
+        unsigned len = in->tail - in->head;
+        char line[MAX_LINE_LEN + 1];
+        for (unsigned k = 0; k < len; k++) {
+            line[k] = in->data[(in->head + k) & (INBUF_SIZE - 1)];
+        }
+        line[len] = '\0';
+        in->head = in->scan = in->tail;
+        dispatch_line(c, line);
+    }
+    close_conn(c);
+}
+
+// 이미 받아 둔 바이트(io_uring 수신 버퍼)를 입력 링 버퍼로 옮기며 처리한다.
+// 처리 중인 연결은 줄 하나 이상을 남기지 않으므로 링이 차지 않지만, 다른
+// 샤드로 넘어가는 동안 링을 넘칠 만큼 보내면 끊는다.
+static void conn_input(struct conn* c, const char* data, size_t len) {
+    struct inbuf* in = &c->in;
+    c->last_active = now_ms();
+    stat_add(&this_shard->stats.n.bytes_in, len);
+    while (len > 0) {
+        unsigned space = INBUF_SIZE - (in->tail - in->head);
+        if (space == 0) {
+            mark_dead(c);
+            return;
+        }
+        unsigned n = len < space ? len : space;
+        unsigned off = in->tail & (INBUF_SIZE - 1);
+        unsigned first = INBUF_SIZE - off < n ? INBUF_SIZE - off : n;
+        memcpy(in->data + off, data, first);
+        memcpy(in->data, data + first, n - first);
+        in->tail += n;
+        data += n;
+        len -= n;
+        process_input(c);
+    }
+}
+
+void read_client(struct conn* c) {
+    struct inbuf* in = &c->in;
+
+    while (conn_reading(c)) {
+        // 링 버퍼의 빈 공간(최대 두 조각)에 한 번의 readv로 받는다.
+        unsigned used = in->tail - in->head;
+        unsigned space = INBUF_SIZE - used;
+        unsigned off = in->tail & (INBUF_SIZE - 1);
+        struct iovec iov[2];
+        int iovcnt = 1;
+        iov[0].iov_base = in->data + off;
+        iov[0].iov_len = INBUF_SIZE - off < space ? INBUF_SIZE - off : space;
+        if (iov[0].iov_len < space) {
+            iov[1].iov_base = in->data;
+            iov[1].iov_len = space - iov[0].iov_len;
+            iovcnt = 2;
+        }
+
+        ssize_t str_len = readv(c->fd, iov, iovcnt);
+        if (str_len == -1 && errno == EINTR) continue;
+        if (str_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+        if (str_len <= 0) {
+            conn_eof(c);
+            return;
+        }
+
+        in->tail += str_len;
+        c->last_active = now_ms();
+        stat_add(&this_shard->stats.n.bytes_in, str_len);
+        process_input(c);
+    }
+}
+
+// 명령 하나를 처리하고, 통계에 쓰도록 실제로 처리한 명령 종류를 돌려준다.
+enum stat_cmd handle_message(struct conn* c, char* buf) {
+    if (c->state != ACTIVE) return CMD_OTHER;
+    struct room* r = c->room;
+    enum stat_cmd kind = CMD_OTHER;
+
+    if (strcmp(buf, "!exit") == 0) {
+        send_str(c, "종료합니다.\n");
+        close_conn(c);
+    }
+    else if (strncmp(buf, "!shout ", 7) == 0) {
+        announce_all(msg_tag(msg_printf("%s📢 [%s@%s] %s%s\n", PURPLE, c->nick, r->name, buf + 7, RESET), FR_SHOUT));
+    }
+    else if (strncmp(buf, "!join", 5) == 0 && (buf[5] == ' ' || buf[5] == '\0')) {
+        const char* name = buf[5] ? buf + 6 : "";
+        if (!room_name_valid(name)) {
+            send_typed(c, FR_ERROR, " 방 이름은 영문, 숫자, _, - 로 1~31글자 입력해주세요. (!join <방이름>)\n");
+        }
+        else if (strcmp(name, r->name) == 0) {
+            send_typed(c, FR_ERROR, " 이미 그 방에 있습니다.\n");
+        }
+        else {
+            struct room* dst = room_get(name, strlen(name));
+            if (dst == NULL) {
+                send_typed(c, FR_ERROR, " 더 이상 방을 만들 수 없습니다.\n");
+                return kind;
+            }
+            room_leave(c, "다른 방으로 이동했습니다");
+            struct msg* m = msg_printf("🚪 [%s] 방으로 이동했습니다.\n", dst->name);
+            conn_send(c, m);
+            msg_unref(m);
+            conn_join(c, dst);
+        }
+    }
+    else if (strcmp(buf, "!stats") == 0) {
+        struct strbuf sb = { 0 };
+        stats_format(&sb, 0);
+        struct msg* m = sb_to_msg(&sb);
+        conn_send(c, m);
+        msg_unref(m);
+    }
+    else if (strcmp(buf, "!rooms") == 0) {
+        struct msg* list = room_list(r);
+        conn_send(c, list);
+        msg_unref(list);
+    }
+    else if (strncmp(buf, "!quiz ", 6) == 0) {
+        kind = CMD_QUIZ;
+        if (r->quiz_active) {
+            send_typed(c, FR_ERROR, " 이미 퀴즈가 진행 중입니다.\n");
+        }
+        else {
+            char* new_word = buf + 6;
+            int jamo = 0;
+            if (strncmp(new_word, "-j ", 3) == 0) {
+                jamo = 1;
+                new_word += 3;
+            }
+            int chars = utf8_count(new_word, strlen(new_word));
+            if (chars < 0) {
+                send_typed(c, FR_ERROR, " 퀴즈 단어가 올바른 UTF-8 문자열이 아닙니다.\n");
+                return kind;
+            }
+            if (chars < 2 || chars > QUIZ_MAX_CHARS) {
+                struct msg* m = msg_tag(msg_printf(" 퀴즈 단어는 2글자 이상, %d글자 이하로 입력해주세요.\n",
+                    QUIZ_MAX_CHARS), FR_ERROR);
+                conn_send(c, m);
+                msg_unref(m);
+                return kind;
+            }
+
+            char key[sizeof(r->current_answer)];
+            size_t key_len = normalize_word(new_word, key, sizeof(key));
+            time_t now = time(NULL);
+            if (word_set_recent(&r->history, key, key_len, now, reuse_window)) {
+                send_typed(c, FR_ERROR, " 이미 출제된 단어입니다.\n");
+            }
+            else {
+                quiz_start(r, new_word, key, key_len, wp_letter_sig(key, key_len), jamo, c);
+            }
+        }
+    }
+    else if (strcmp(buf, "!auto off") == 0) {
+        if (r->auto_on) {
+            r->auto_on = 0;
+            timer_del(&r->auto_timer);
+            broadcast(r, NULL, msg_printf("🤖 %s 님이 자동 출제를 껐습니다.\n", c->nick));
+        }
+        else {
+            send_typed(c, FR_ERROR, " 자동 출제 중이 아닙니다.\n");
+        }
+    }
+    else if (strcmp(buf, "!auto on") == 0 || strncmp(buf, "!auto on ", 9) == 0) {
+        int tier = 1;
+        if (buf[8] != '\0') {
+            for (tier = 0; tier < WP_TIERS; tier++) {
+                if (strcmp(buf + 9, tier_keys[tier]) == 0 || strcmp(buf + 9, tier_names[tier]) == 0) break;
+            }
+        }
+        if (pool.hdr == NULL) {
+            send_typed(c, FR_ERROR, " 단어 풀이 없어 자동 출제를 할 수 없습니다.\n");
+        }
+        else if (tier == WP_TIERS) {
+            send_typed(c, FR_ERROR, " 난이도는 easy(쉬움), normal(보통), hard(어려움) 중에서 골라주세요.\n");
+        }
+        else if (pool.hdr->tier_start[tier] == pool.hdr->tier_start[tier + 1]) {
+            send_typed(c, FR_ERROR, " 그 난이도에는 단어가 없습니다.\n");
+        }
+        else {
+            r->auto_on = 1;
+            r->auto_tier = tier;
+            broadcast(r, NULL, msg_printf("🤖 %s 님이 자동 출제를 켰습니다. (난이도: %s)\n", c->nick, tier_names[tier]));
+            if (!r->quiz_active) timer_add(&r->auto_timer, AUTO_QUIZ_DELAY_MS, auto_quiz);
+        }
+    }
+    else if (strcmp(buf, "!score") == 0) {
+        kind = CMD_SCORE;
+        struct msg* board = lb_score_board(&r->lb, r->members_head);
+        conn_send(c, board);
+        msg_unref(board);
+
+        struct conn* top = lb_next(&r->lb, NULL);
+
+        char temp_lcd_score[LCD_MSG_LEN];
+        if (top) {
+            snprintf(temp_lcd_score, sizeof(temp_lcd_score), "Top Score!\n%.16s: %d", top->nick, top->score);
+        }
+        else {
+            snprintf(temp_lcd_score, sizeof(temp_lcd_score), "Scoreboard\nNo Players");
+        }
+        send_to_lcd(temp_lcd_score, LCD_PRIO_NORMAL);
+    }
+    else if (strcmp(buf, "!rank") == 0 || strcmp(buf, "!rank all") == 0) {
+        kind = CMD_RANK;
+        struct msg* board = lb_rank_board(&r->lb, buf[5] != '\0');
+        conn_send(c, board);
+        msg_unref(board);
+
+        int ties = r->lb.buckets[c->score].count;
+        struct msg* mine = msg_tag(msg_printf("내 순위: %s%d위 (%d점)\n", ties > 1 ? "공동 " : "", lb_rank_of(&r->lb, c), c->score), FR_BOARD);
+        conn_send(c, mine);
+        msg_unref(mine);
+
+        struct conn* first = lb_next(&r->lb, NULL);
+        struct conn* second = first ? lb_next(&r->lb, first) : NULL;
+        char lcd_rank_msg[LCD_MSG_LEN];
+        if (second) {
+            snprintf(lcd_rank_msg, sizeof(lcd_rank_msg), "1st:%.8s %d\n2nd:%.8s %d",
+                first->nick, first->score, second->nick, second->score);
+        }
+        else if (first) {
+            snprintf(lcd_rank_msg, sizeof(lcd_rank_msg), "1st:%.8s %d\n", first->nick, first->score);
+        }
+        else {
+            snprintf(lcd_rank_msg, sizeof(lcd_rank_msg), "Rankings\nNo Players");
+        }
+        send_to_lcd(lcd_rank_msg, LCD_PRIO_NORMAL);
+    }
+    else if (r->quiz_active) {
+        kind = CMD_GUESS;
+        if (answer_accepted(r, buf)) {
+            lb_add_score(&r->lb, c, 1);
+            score_record(r, c->nick, 1);
+            // 대소문자나 앞뒤 공백만 다르면 출제 단어를 맞춘 것으로 알린다.
+            char key[QUIZ_WORD_SIZE];
+            size_t key_len = normalize_word(buf, key, sizeof(key));
+            if (key_len == r->answer_len && memcmp(key, r->answer_key, key_len) == 0) {
+                broadcast(r, NULL, msg_tag(msg_printf("🎉 정답! %s 님이 %s을(를) 맞췄습니다! (+1점)\n",
+                    c->nick, r->current_answer), FR_CORRECT));
+            }
+            else {
+                broadcast(r, NULL, msg_tag(msg_printf("🎉 정답! %s 님이 %s을(를) 맞췄습니다! (출제 단어: %s, +1점)\n",
+                    c->nick, buf, r->current_answer), FR_CORRECT));
+            }
+
+            char lcd_win_msg[LCD_MSG_LEN];
+            snprintf(lcd_win_msg, sizeof(lcd_win_msg), "WINNER:%.9s\nAns:%.12s", c->nick, r->current_answer);
+            send_to_lcd(lcd_win_msg, LCD_PRIO_HIGH);
+            quiz_end(r);
+        }
+        else {
+            send_typed(c, FR_WRONG, RED "❌ 틀렸습니다. 다시 시도하세요.\n" RESET);
+            broadcast(r, c, msg_tag(msg_printf("%s%s 님이 오답을 시도했습니다.\n%s", CYAN, c->nick, RESET), FR_WRONG));
+        }
+    }
+    else {
+        broadcast(r, c, msg_tag(msg_printf("%s: %s\n", c->nick, buf), FR_CHAT));
+        kind = CMD_CHAT;
+    }
+    return kind;
+}
+
+// --- io_uring 백엔드 ---
+// -b uring으로 켠다. 샤드마다 링을 하나 두고 리스너에는 멀티샷 accept를,
+// 클라이언트에는 제공 버퍼 링에서 버퍼를 골라 받는 멀티샷 recv를 한 번씩만
+// 걸어 둔다. 송신은 conn_flush가 연결을 send_list에 모아 두었다가 루프 끝에서
+// 연결마다 sendmsg 하나(대기열 최대 OUTQ_IOV_MAX개)로 만들어, 완료 대기와 함께
+// io_uring_enter 한 번으로 제출한다. 방 하나에 수백 명이 있어도 브로드캐스트
+// 한 번의 송신 시스템 콜은 하나다. 입력 처리와 게임 로직은 epoll과 같은 함수를
+// 그대로 쓴다.
+//
+// 완료 이벤트의 user_data는 핸들(연결) 포인터에 작업 종류를 낮은 비트로 붙인
+// 값이다. recv나 send가 걸려 있는 연결은 닫히거나 다른 샤드로 넘어갈 때 바로
+// 놓지 않고, 마지막 완료가 왔을 때 uring_release에서 마저 처리한다.
+
+enum uring_op {
+    UOP_ACCEPT,
+    UOP_POLL,       // timerfd, 우편함 eventfd
+    UOP_RECV,
+    UOP_SEND,
+    UOP_CANCEL,
+};
+
+#define UOP_MASK 7ULL
+#define URING_DATA(c, op) ((uint64_t)(uintptr_t)(c) | (op))
+
+int uring_recv_multishot = 1;   // 커널이 멀티샷 recv를 거절하면 한 번씩 다시 건다
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned op, void* arg, unsigned n) {
+    return syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+static void uring_exit(struct uring* u) {
+    if (u->br) munmap(u->br, u->br_entries * sizeof(struct io_uring_buf));
+    free(u->bufs);
+    if (u->sqes) munmap(u->sqes, u->sqes_len);
+    if (u->cq_map && u->cq_map != u->sq_map) munmap(u->cq_map, u->cq_map_len);
+    if (u->sq_map) munmap(u->sq_map, u->sq_map_len);
+    if (u->fd != -1) close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+// 수신 버퍼 bid를 제공 버퍼 링에 돌려준다.
+static void uring_buf_put(struct uring* u, unsigned short bid) {
+    struct io_uring_buf* b = &u->br->bufs[u->br_tail & (u->br_entries - 1)];
+    b->addr = (uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE;
+    b->bid = bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+// 링을 만들고 큐를 mmap 한 뒤 수신 버퍼 nbufs개(2의 거듭제곱)를 제공 버퍼
+// 링(그룹 0)으로 등록한다. 제공 버퍼 링과 멀티샷 accept는 같은 커널(5.19)부터
+// 있으므로 등록이 되면 둘 다 쓸 수 있다.
+static int uring_init(struct uring* u, unsigned entries, unsigned nbufs) {
+    struct io_uring_params p;
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;
+    u->fd = sys_io_uring_setup(entries, &p);
+    if (u->fd == -1) return -1;
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_map_len > u->sq_map_len) u->sq_map_len = u->cq_map_len;
+        u->cq_map_len = u->sq_map_len;
+    }
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) {
+        u->sq_map = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_map = u->sq_map;
+    }
+    else {
+        u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_map == MAP_FAILED) {
+            u->cq_map = NULL;
+            goto fail;
+        }
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    char* sq = u->sq_map;
+    char* cq = u->cq_map;
+    u->sq_khead = (unsigned*)(sq + p.sq_off.head);
+    u->sq_ktail = (unsigned*)(sq + p.sq_off.tail);
+    u->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_tail = *u->sq_ktail;
+    // SQE 번호를 그대로 쓴다.
+    unsigned* array = (unsigned*)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+    u->cq_khead = (unsigned*)(cq + p.cq_off.head);
+    u->cq_ktail = (unsigned*)(cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    u->br = mmap(NULL, nbufs * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) {
+        u->br = NULL;
+        goto fail;
+    }
+    u->br_entries = nbufs;
+    u->bufs = malloc((size_t)nbufs * URING_BUF_SIZE);
+    if (u->bufs == NULL) goto fail;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)u->br;
+    reg.ring_entries = nbufs;
+    reg.bgid = 0;
+    if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) goto fail;
+    for (unsigned i = 0; i < nbufs; i++) uring_buf_put(u, i);
+    return 0;
+
+fail:;
+    int err = errno;
+    uring_exit(u);
+    errno = err;
+    return -1;
+}
+
+// 채워 둔 SQE를 제출하고 wait개의 완료를 기다린다.
+static int uring_enter(unsigned wait) {
+    struct uring* u = &this_shard->ring;
+    unsigned submit = u->sq_tail - *u->sq_ktail;
+    __atomic_store_n(u->sq_ktail, u->sq_tail, __ATOMIC_RELEASE);
+    if (submit == 0 && wait == 0) return 0;
+    return sys_io_uring_enter(u->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+}
+
+// 빈 SQE를 하나 꺼낸다. 제출 큐가 가득 차면 먼저 제출한다.
+static struct io_uring_sqe* uring_sqe(void) {
+    struct uring* u = &this_shard->ring;
+    if (u->sq_tail - __atomic_load_n(u->sq_khead, __ATOMIC_ACQUIRE) == u->sq_entries
+        && uring_enter(0) == -1) {
+        perror("io_uring_enter() 실패");
+    }
+    struct io_uring_sqe* sqe = &u->sqes[u->sq_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_tail++;
+    return sqe;
+}
+
+static void uring_accept(struct conn* l) {
+    struct io_uring_sqe* sqe = uring_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = l->fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = URING_DATA(l, UOP_ACCEPT);
+}
+
+// accept가 오류로 끝났으면 잠시 뒤 다시 건다 (fd가 모자랄 때 헛돌지 않도록).
+static void accept_retry(struct timer* t) {
+    uring_accept(container_of(t, struct conn, timer));
+}
+
+static void uring_poll(struct conn* h) {
+    struct io_uring_sqe* sqe = uring_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = h->fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = URING_DATA(h, UOP_POLL);
+}
+
+void uring_recv(struct conn* c) {
+    struct io_uring_sqe* sqe = uring_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->ioprio = __atomic_load_n(&uring_recv_multishot, __ATOMIC_RELAXED) ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = URING_DATA(c, UOP_RECV);
+    c->recv_armed = 1;
+}
+
+// 다른 샤드로 넘길 준비. 걸린 작업이 없으면 0을 돌려 바로 넘기게 하고,
+// 있으면 recv를 취소해 두고 1을 돌려준다.
+int uring_detach(struct conn* c) {
+    if (!c->recv_armed && !c->out.inflight) return 0;
+    if (c->recv_armed && !c->detaching) {
+        struct io_uring_sqe* sqe = uring_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = URING_DATA(c, UOP_RECV);
+        sqe->user_data = URING_DATA(c, UOP_CANCEL);
+    }
+    c->detaching = 1;
+    return 1;
+}
+
+// 걸린 작업이 모두 끝난 연결을 마저 정리한다. 닫힌 연결은 slab 칸을 해제
+// 목록에 올리고, 넘어가는 연결은 flush_moves가 넘기도록 다시 목록에 올린다.
+static void uring_release(struct conn* c) {
+    if (c->recv_armed || c->out.inflight) return;
+    if (c->state == CLOSING) {
+        outq_free_all(&c->out);
+        c->close_next = this_shard->close_list;
+        this_shard->close_list = c;
+    }
+    else if (c->state == MIGRATING && c->detaching) {
+        c->detaching = 0;
+        c->move_next = this_shard->move_list;
+        this_shard->move_list = c;
+    }
+}
+
+// send_list의 연결마다 대기열 앞쪽을 sendmsg 하나로 제출한다. 연결마다
+// 동시에 하나만 보내며, 완료되면 남은 것을 다시 올린다.
+static void uring_flush_sends(void) {
+    while (this_shard->send_list) {
+        struct conn* c = this_shard->send_list;
+        this_shard->send_list = c->send_next;
+        c->flush_queued = 0;
+        if (c->dead || (c->state != AWAITING_NICK && c->state != ACTIVE)) continue;
+        if (c->out.inflight || c->out.head == c->out.tail) continue;
+
+        int cnt = outq_fill_iov(c, c->send_iov);
+        memset(&c->send_msg, 0, sizeof(c->send_msg));
+        c->send_msg.msg_iov = c->send_iov;
+        c->send_msg.msg_iovlen = cnt;
+        c->out.inflight = cnt;
+        c->send_framed = c->framed;
+
+        struct io_uring_sqe* sqe = uring_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = c->fd;
+        sqe->addr = (uintptr_t)&c->send_msg;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = URING_DATA(c, UOP_SEND);
+    }
+}
+
+static void uring_recv_done(struct conn* c, const struct io_uring_cqe* cqe) {
+    struct uring* u = &this_shard->ring;
+    int res = cqe->res;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) c->recv_armed = 0;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0 && c->state != CLOSING) conn_input(c, u->bufs + (size_t)bid * URING_BUF_SIZE, res);
+        uring_buf_put(u, bid);
+    }
+    if (c->recv_armed) return;
+
+    if (c->state == CLOSING || c->state == MIGRATING) {
+        uring_release(c);
+    }
+    else if (res > 0 || res == -ENOBUFS) {
+        // 한 번짜리 recv였거나 버퍼가 모자라 멈췄다.
+        uring_recv(c);
+    }
+    else if (res == -EINVAL && __atomic_load_n(&uring_recv_multishot, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&uring_recv_multishot, 0, __ATOMIC_RELAXED);
+        uring_recv(c);
+    }
+    else {
+        conn_eof(c);
+    }
+}
+
+static void uring_send_done(struct conn* c, int res) {
+    c->out.inflight = 0;
+    if (c->state == CLOSING || c->state == MIGRATING) {
+        uring_release(c);
+        return;
+    }
+    if (res < 0) {
+        mark_dead(c);
+        return;
+    }
+    outq_consume(&c->out, res, c->send_framed);
+    stat_add(&this_shard->stats.n.bytes_out, res);
+    // 텍스트로 보내던 중에 프레임으로 바뀌었으면 남은 조각을 이어 보낼 수 없다.
+    if (c->send_framed != c->framed && c->out.head_off > 0) {
+        mark_dead(c);
+        return;
+    }
+    if (c->out.bytes < outq_high) c->out.over_since = 0;
+    conn_flush(c);
+}
+
+static void uring_complete(const struct io_uring_cqe* cqe) {
+    struct conn* c = (struct conn*)(uintptr_t)(cqe->user_data & ~UOP_MASK);
+    int more = cqe->flags & IORING_CQE_F_MORE;
+
+    switch (cqe->user_data & UOP_MASK) {
+    case UOP_ACCEPT:
+        if (cqe->res >= 0) conn_accepted(cqe->res);
+        else fprintf(stderr, "accept() 실패: %s\n", strerror(-cqe->res));
+        if (!more) {
+            if (cqe->res >= 0) uring_accept(c);
+            else timer_add(&c->timer, TIMER_TICK_MS, accept_retry);
+        }
+        break;
+    case UOP_POLL:
+        if (c->kind == H_TIMER) drain_timerfd();
+        else drain_mailbox();
+        if (!more) uring_poll(c);
+        break;
+    case UOP_RECV:
+        uring_recv_done(c, cqe);
+        break;
+    case UOP_SEND:
+        uring_send_done(c, cqe->res);
+        break;
+    }
+}
+
+// io_uring 이벤트 루프. 한 바퀴에 시스템 콜은 제출과 대기를 함께 하는
+// io_uring_enter 하나다.
+static void uring_loop(void) {
+    struct uring* u = &this_shard->ring;
+    uring_accept(&this_shard->listener);
+    uring_poll(&this_shard->timer_handle);
+    uring_poll(&this_shard->mail_handle);
+
+    while (1) {
+        if (uring_enter(1) == -1 && errno != EINTR && errno != EBUSY) {
+            perror("io_uring_enter() 실패");
+            break;
+        }
+        long long t0 = now_ns();
+
+        unsigned head = *u->cq_khead;
+        unsigned first = head;
+        while (head != __atomic_load_n(u->cq_ktail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+            __atomic_store_n(u->cq_khead, ++head, __ATOMIC_RELEASE);
+            uring_complete(&cqe);
+        }
+
+        close_dead();
+        // 넘길 연결이 send_list에 남지 않도록 flush_moves보다 먼저 비운다.
+        uring_flush_sends();
+        flush_moves();
+        reap_closed();
+
+        struct shard_stats* st = &this_shard->stats;
+        stat_add(&st->n.loops, 1);
+        stat_add(&st->n.events, head - first);
+        stat_hist_add(&st->loop_ns, now_ns() - t0);
+    }
+}
+
+// 샤드 하나의 이벤트 루프
+void* shard_main(void* arg) {
+    this_shard = arg;
+    if (use_uring) {
+        uring_loop();
+        return NULL;
+    }
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        // 밀린 accept가 있으면 기다리지 않는다. 시간 제한은 timerfd가 깨운다.
+        int n = epoll_wait(this_shard->epfd, events, MAX_EVENTS, this_shard->accept_pending ? 0 : -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        long long t0 = now_ns();
+
+        int listener_ready = this_shard->accept_pending;
+        for (int e = 0; e < n; e++) {
+            struct conn* c = conn_by_fd(events[e].data.fd);
+            if (c == NULL) continue;  // 같은 배치에서 이미 닫힌 연결
+            if (c->kind == H_LISTENER) {
+                listener_ready = 1;
+                continue;
+            }
+            if (c->kind == H_TIMER) {
+                drain_timerfd();
+                continue;
+            }
+            if (c->kind == H_MAILBOX) {
+                drain_mailbox();
+                continue;
+            }
+            if ((events[e].events & EPOLLOUT) && c->state != CLOSING && !c->dead) {
+                if (conn_flush(c) == -1) mark_dead(c);
+            }
+            if (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                read_client(c);
+            }
+        }
+        if (listener_ready) accept_clients();
+
+        close_dead();
+        flush_moves();
+        reap_closed();
+
+        struct shard_stats* st = &this_shard->stats;
+        stat_add(&st->n.loops, 1);
+        stat_add(&st->n.events, n);
+        stat_hist_add(&st->loop_ns, now_ns() - t0);
+    }
+    return NULL;
+}
+
+// 샤드마다 리스너(SO_REUSEPORT), epoll 또는 io_uring, timerfd, 우편함 eventfd를
+// 만든다. io_uring이면 핸들은 루프를 시작할 때 링에 건다.
+static int shard_init(struct shard* s, int port) {
+    struct sockaddr_in serv_addr;
+    struct epoll_event ev;
+
+    s->listener.kind = H_LISTENER;
+    s->timer_handle.kind = H_TIMER;
+    s->mail_handle.kind = H_MAILBOX;
+    mailbox_init(&s->mail);
+
+    s->listener.fd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(s->listener.fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // 같은 포트에 샤드마다 리스너를 열면 커널이 새 연결을 나눠 준다.
+    setsockopt(s->listener.fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(port);
+
+    if (bind(s->listener.fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == -1) {
+        perror("bind() 실패");
+        return -1;
+    }
+    if (listen(s->listener.fd, SOMAXCONN) == -1) {
+        perror("listen() 실패");
+        return -1;
+    }
+
+    s->timer_handle.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (s->timer_handle.fd == -1) {
+        perror("timerfd_create() 실패");
+        return -1;
+    }
+    s->mail_handle.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->mail_handle.fd == -1) {
+        perror("eventfd() 실패");
+        return -1;
+    }
+
+    if (use_uring) {
+        s->epfd = -1;
+        if (uring_init(&s->ring, URING_ENTRIES, URING_BUFS) == -1) {
+            perror("io_uring 설정 실패");
+            return -1;
+        }
+        return 0;
+    }
+
+    set_nonblocking(s->listener.fd);
+    s->ring.fd = -1;
+    s->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (s->epfd == -1) {
+        perror("epoll_create1() 실패");
+        return -1;
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = s->listener.fd;
+    fd_table[s->listener.fd] = &s->listener;
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->listener.fd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.fd = s->timer_handle.fd;
+    fd_table[s->timer_handle.fd] = &s->timer_handle;
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->timer_handle.fd, &ev);
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = s->mail_handle.fd;
+    fd_table[s->mail_handle.fd] = &s->mail_handle;
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->mail_handle.fd, &ev);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    srand(time(NULL));
+    int port = DEFAULT_PORT;
+    const char* history_path = DEFAULT_HISTORY_PATH;
+    const char* score_path = DEFAULT_SCORE_PATH;
+    const char* dict_path = NULL;
+    const char* pool_path = NULL;
+    const char* admin_path = NULL;
+    int opt;
+
+    start_ms = now_ms();
+    while ((opt = getopt(argc, argv, "p:m:n:i:w:q:b:H:S:r:t:d:W:A:")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'm':
+            max_clients = atoi(optarg);
+            break;
+        case 'n':
+            nick_timeout_ms = atoi(optarg) * 1000;
+            break;
+        case 'i':
+            idle_timeout_ms = atoi(optarg) * 1000;
+            break;
+        case 'w':
+            outq_high = strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            if (strcmp(optarg, "drop") == 0) outq_policy = OUTQ_DROP;
+            else if (strcmp(optarg, "squash") == 0) outq_policy = OUTQ_SQUASH;
+            else {
+                fprintf(stderr, "알 수 없는 송신 대기열 정책: %s (drop|squash)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            if (strcmp(optarg, "uring") == 0) use_uring = 1;
+            else if (strcmp(optarg, "epoll") == 0) use_uring = 0;
+            else {
+                fprintf(stderr, "알 수 없는 이벤트 백엔드: %s (epoll|uring)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            history_path = optarg;
+            break;
+        case 'S':
+            score_path = optarg;
+            break;
+        case 'r':
+            reuse_window = atoi(optarg);
+            break;
+        case 't':
+            num_shards = atoi(optarg);
+            break;
+        case 'd':
+            dict_path = optarg;
+            break;
+        case 'W':
+            pool_path = optarg;
+            break;
+        case 'A':
+            admin_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "사용법: %s [-p 포트] [-m 최대접속자수] [-n 닉네임제한초] [-i 유휴제한초] [-w 송신대기열바이트] [-q drop|squash]\n"
+                "          [-b epoll|uring] [-H 출제기록파일|-] [-S 점수저장소|-] [-r 단어재사용초] [-t 스레드수] [-d 사전파일] [-W 단어풀파일]\n"
+                "          [-A 관리소켓경로]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_clients <= 0) max_clients = DEFAULT_MAX_CLIENT;
+    if (nick_timeout_ms <= 0) nick_timeout_ms = DEFAULT_NICK_TIMEOUT * 1000;
+    if (outq_high == 0) outq_high = DEFAULT_OUTQ_HIGH;
+
+    if (reuse_window < 0) reuse_window = 0;
+    if (num_shards < 1 || num_shards > MAX_SHARDS) num_shards = 1;
+
+    // 방을 만들 때 맡을 샤드를 정하므로 샤드 배열을 먼저 잡는다.
+    shards = calloc(num_shards, sizeof(*shards));
+    if (shards == NULL) {
+        fprintf(stderr, "샤드 할당 실패\n");
+        return 1;
+    }
+    lobby = room_get(DEFAULT_ROOM, strlen(DEFAULT_ROOM));
+    if (strcmp(history_path, "-") != 0) history_load(history_path);
+    if (strcmp(score_path, "-") != 0) score_open(score_path);
+    if (dict_path) dict_load(dict_path);
+    if (pool_path) pool_open(pool_path);
+
+    // 끊긴 소켓에 쓸 때 프로세스가 죽지 않도록 한다. 오류는 EPIPE로 받는다.
+    signal(SIGPIPE, SIG_IGN);
+
+    // 접속자 수만큼 fd를 쓸 수 있도록 소프트 한도를 올린다.
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)max_clients + 64) {
+        rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > (rlim_t)max_clients + 64)
+            ? (rlim_t)max_clients + 64 : rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) perror("setrlimit(RLIMIT_NOFILE) 실패");
+    }
+    fd_table_size = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+        ? (int)rl.rlim_cur : max_clients + 64;
+
+    // 세션 테이블은 시작할 때 한 번만 할당한다.
+    conn_slab = calloc(max_clients, sizeof(*conn_slab));
+    free_slots = malloc(sizeof(*free_slots) * max_clients);
+    fd_table = calloc(fd_table_size, sizeof(*fd_table));
+    if (conn_slab == NULL || free_slots == NULL || fd_table == NULL) {
+        fprintf(stderr, "세션 테이블 할당 실패 (최대 %d명)\n", max_clients);
+        return 1;
+    }
+    for (int s = max_clients - 1; s >= 0; s--) {
+        free_slots[free_top++] = s;
+    }
+
+    lcd_open_all();
+    if (lcd_fds[LCD_PRIO_NORMAL] != -1) {
+        printf("I2C LCD 장치 '%s' 열림.\n", LCD_DEVICE_PATH);
+        char lcd_start_msg[LCD_MSG_LEN];
+        snprintf(lcd_start_msg, sizeof(lcd_start_msg), "Server Started!\nPort:%d", port);
+        send_to_lcd(lcd_start_msg, LCD_PRIO_NORMAL);
+    }
+
+    // io_uring을 못 쓰는 커널(5.19 미만)이거나 막혀 있으면 epoll로 돌린다.
+    if (use_uring) {
+        struct uring probe;
+        if (uring_init(&probe, 8, 8) == -1) {
+            fprintf(stderr, "경고: io_uring을 쓸 수 없어 epoll로 동작합니다. (%s)\n", strerror(errno));
+            use_uring = 0;
+        }
+        else {
+            uring_exit(&probe);
+        }
+    }
+
+    for (int i = 0; i < num_shards; i++) {
+        if (shard_init(&shards[i], port) == -1) return 1;
+    }
+
+    if (admin_path) admin_open(admin_path);
+
+    printf("서버 시작 (포트 %d, 최대 %d명, 스레드 %d개, %s)\n", port, max_clients, num_shards,
+        use_uring ? "io_uring" : "epoll");
+
+    // 샤드 0은 메인 스레드가 돌린다.
+    for (int i = 1; i < num_shards; i++) {
+        if (pthread_create(&shards[i].thread, NULL, shard_main, &shards[i]) != 0) {
+            fprintf(stderr, "스레드 생성 실패\n");
+            return 1;
+        }
+    }
+    shard_main(&shards[0]);
+
+    if (lcd_fds[LCD_PRIO_NORMAL] != -1) {
+        for (int p = 0; p < LCD_PRIO_LEVELS; p++) {
+            if (p == LCD_PRIO_NORMAL || lcd_fds[p] != lcd_fds[LCD_PRIO_NORMAL]) close(lcd_fds[p]);
+        }
+        if (lcd_cells) munmap(lcd_cells, LCD_CELLS);
+        printf("I2C LCD 장치 '%s' 닫힘.\n", LCD_DEVICE_PATH);
+    }
+    if (history_fd != -1) close(history_fd);
+    return 0;
+}
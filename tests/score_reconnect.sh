@@ -0,0 +1,72 @@
+#!/bin/bash
+# 점수가 접속한 샤드나 스레드 수와 상관없이 이어지는지 확인한다.
+# -t 4로 띄운 서버에서 정답을 맞춘 뒤 여러 번 다시 접속하고(출발 포트가
+# 달라 SO_REUSEPORT가 다른 샤드에 넘긴다), -t 3으로 다시 띄워서도 본다.
+# 사용법: tests/score_reconnect.sh [server 경로] [포트]
+set -u
+
+SERVER=${1:-./server}
+PORT=${2:-9555}
+dir=$(mktemp -d)
+pid=
+
+cleanup() {
+    [ -n "$pid" ] && kill "$pid" 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+start() {
+    "$SERVER" -p "$PORT" -t "$1" -H - -S "$dir/scores" >"$dir/log" 2>&1 &
+    pid=$!
+    sleep 0.5
+}
+
+stop() {
+    kill "$pid"
+    wait "$pid" 2>/dev/null
+    pid=
+}
+
+fail() {
+    echo "실패: $*"
+    cat "$dir/log"
+    exit 1
+}
+
+# fd에 한 줄 보내고 잠시 기다린다.
+say() {
+    printf '%s\n' "$2" >&"$1"
+    sleep 0.2
+}
+
+# 닉네임으로 접속해 !score를 보내고 받은 내용을 출력한다.
+score_of() {
+    exec 5<>"/dev/tcp/127.0.0.1/$PORT" || return
+    say 5 "$1"
+    say 5 "!score"
+    timeout 0.3 cat <&5
+    exec 5<&-
+}
+
+start 4
+exec 3<>"/dev/tcp/127.0.0.1/$PORT" || fail "접속 실패"
+exec 4<>"/dev/tcp/127.0.0.1/$PORT" || fail "접속 실패"
+say 3 setter
+say 4 solver
+say 3 "!quiz banana"
+say 4 "banana"
+timeout 0.3 cat <&4 | grep -q "정답! solver" || fail "정답 처리 안 됨"
+exec 3<&- 4<&-
+sleep 0.2
+
+for i in 1 2 3 4 5 6 7 8; do
+    score_of solver | grep -q "solver: 1점" || fail "다시 접속 $i번째에 점수가 없음"
+done
+stop
+
+start 3
+score_of solver | grep -q "solver: 1점" || fail "-t 3으로 재시작한 뒤 점수가 없음"
+stop
+
+echo "통과: score_reconnect"
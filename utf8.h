@@ -0,0 +1,123 @@
+// UTF-8 디코딩과 한글 음절 분해
+// server와 wordpool이 같은 규칙으로 글자를 세고 서명을 만들도록 함께 쓴다.
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTF8_INVALID 0xFFFFFFFFu
+
+#define HANGUL_BASE 0xAC00      // 가
+#define HANGUL_LAST 0xD7A3      // 힣
+
+// *p에서 코드 포인트 하나를 읽고 *p를 다음 글자로 옮긴다. 잘못된 바이트면
+// UTF8_INVALID를 돌려주고 한 바이트만 건너뛴다.
+static inline uint32_t utf8_next(const char** p, const char* end) {
+    const unsigned char* s = (const unsigned char*)*p;
+    uint32_t cp;
+    int extra;
+
+    if (s[0] < 0x80) {
+        *p += 1;
+        return s[0];
+    }
+    else if ((s[0] & 0xE0) == 0xC0) {
+        cp = s[0] & 0x1F;
+        extra = 1;
+    }
+    else if ((s[0] & 0xF0) == 0xE0) {
+        cp = s[0] & 0x0F;
+        extra = 2;
+    }
+    else if ((s[0] & 0xF8) == 0xF0) {
+        cp = s[0] & 0x07;
+        extra = 3;
+    }
+    else {
+        *p += 1;
+        return UTF8_INVALID;
+    }
+
+    if (end - (const char*)s <= extra) {
+        *p += 1;
+        return UTF8_INVALID;
+    }
+    for (int i = 1; i <= extra; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *p += 1;
+            return UTF8_INVALID;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    // 너무 길게 인코딩된 값, 서로게이트, 범위 밖 값은 받지 않는다.
+    if ((extra == 1 && cp < 0x80) || (extra == 2 && cp < 0x800) || (extra == 3 && cp < 0x10000)
+        || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+        *p += 1;
+        return UTF8_INVALID;
+    }
+    *p += extra + 1;
+    return cp;
+}
+
+// 코드 포인트를 UTF-8로 쓴다. 쓴 바이트 수를 돌려준다 (out은 4바이트 이상).
+static inline int utf8_put(uint32_t cp, char* out) {
+    unsigned char* o = (unsigned char*)out;
+    if (cp < 0x80) {
+        o[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        o[0] = 0xC0 | (cp >> 6);
+        o[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        o[0] = 0xE0 | (cp >> 12);
+        o[1] = 0x80 | ((cp >> 6) & 0x3F);
+        o[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    o[0] = 0xF0 | (cp >> 18);
+    o[1] = 0x80 | ((cp >> 12) & 0x3F);
+    o[2] = 0x80 | ((cp >> 6) & 0x3F);
+    o[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// 글자 수(코드 포인트 수). 올바른 UTF-8이 아니면 -1.
+static inline int utf8_count(const char* s, size_t len) {
+    const char* end = s + len;
+    int n = 0;
+    while (s < end) {
+        if (utf8_next(&s, end) == UTF8_INVALID) return -1;
+        n++;
+    }
+    return n;
+}
+
+static inline int is_hangul_syllable(uint32_t cp) {
+    return cp >= HANGUL_BASE && cp <= HANGUL_LAST;
+}
+
+// 한글 음절을 호환 자모(ㄱ, ㅏ 등)로 나눈다. 나눈 개수(2~3)를 돌려준다.
+static inline int hangul_split(uint32_t cp, uint32_t out[3]) {
+    static const uint16_t lead[19] = {
+        0x3131, 0x3132, 0x3134, 0x3137, 0x3138, 0x3139, 0x3141, 0x3142, 0x3143, 0x3145,
+        0x3146, 0x3147, 0x3148, 0x3149, 0x314A, 0x314B, 0x314C, 0x314D, 0x314E,
+    };
+    static const uint16_t tail[28] = {
+        0, 0x3131, 0x3132, 0x3133, 0x3134, 0x3135, 0x3136, 0x3137, 0x3139, 0x313A,
+        0x313B, 0x313C, 0x313D, 0x313E, 0x313F, 0x3140, 0x3141, 0x3142, 0x3144, 0x3145,
+        0x3146, 0x3147, 0x3148, 0x314A, 0x314B, 0x314C, 0x314D, 0x314E,
+    };
+    uint32_t s = cp - HANGUL_BASE;
+    out[0] = lead[s / 588];
+    out[1] = 0x314F + (s % 588) / 28;   // ㅏ부터 차례대로
+    if (s % 28 == 0) return 2;
+    out[2] = tail[s % 28];
+    return 3;
+}
+
+#endif
@@ -0,0 +1,207 @@
+// 단어 풀 생성기: 한 줄에 한 단어인 목록을 server가 mmap 하는 풀 파일로 만든다.
+// 사용법: wordpool <단어목록.txt> <풀파일>
+// 단어는 UTF-8이며 영문자나 한글 음절로만 되어 있어야 한다.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "wordpool.h"
+
+#define MIN_WORD_CHARS 3
+#define MIN_HANGUL_CHARS 2  // 한글은 두 음절 단어도 받는다
+#define MAX_WORD_CHARS 50   // server의 퀴즈 단어 최대 글자 수 (QUIZ_MAX_CHARS)
+
+struct word {
+    char* text;
+    uint32_t len;
+    uint32_t weight;        // 난이도용 글자 수 (한글 음절은 자모가 여럿이라 2로 센다)
+    uint64_t sig;
+    uint8_t tier;
+    uint16_t anagrams;
+};
+
+static int cmp_text(const void* a, const void* b) {
+    const struct word* x = a;
+    const struct word* y = b;
+    return strcmp(x->text, y->text);
+}
+
+static int cmp_sig(const void* a, const void* b) {
+    const struct word* x = a;
+    const struct word* y = b;
+    if (x->sig != y->sig) return x->sig < y->sig ? -1 : 1;
+    return strcmp(x->text, y->text);
+}
+
+static int cmp_tier(const void* a, const void* b) {
+    const struct word* x = a;
+    const struct word* y = b;
+    if (x->tier != y->tier) return x->tier - y->tier;
+    return strcmp(x->text, y->text);
+}
+
+// 글자 수로 난이도를 정하고, 같은 글자로 다른 단어도 만들 수 있으면
+// 정답이 여럿이라 한 단계 쉽게 본다.
+static uint8_t word_tier(const struct word* w) {
+    int tier = w->weight <= 5 ? 0 : w->weight <= 7 ? 1 : 2;
+    if (w->anagrams > 0 && tier > 0) tier--;
+    return tier;
+}
+
+// 앞뒤 공백을 자르고 영문자를 소문자로 바꾼다. 영문자나 한글 음절만으로 된
+// 단어가 아니거나 글자 수가 범위를 벗어나면 0.
+static size_t clean_word(char* s, uint32_t* weight) {
+    char* p = s;
+    while (*p && isspace((unsigned char)*p)) p++;
+    size_t len = strlen(p);
+    while (len > 0 && isspace((unsigned char)p[len - 1])) len--;
+
+    const char* q = p;
+    const char* end = p + len;
+    int chars = 0, hangul = 0;
+    while (q < end) {
+        uint32_t cp = utf8_next(&q, end);
+        if (is_hangul_syllable(cp)) hangul++;
+        else if (cp >= 0x80 || !isalpha(cp)) return 0;
+        chars++;
+    }
+    if (chars < (hangul ? MIN_HANGUL_CHARS : MIN_WORD_CHARS) || chars > MAX_WORD_CHARS) return 0;
+
+    for (size_t i = 0; i < len; i++) {
+        s[i] = tolower((unsigned char)p[i]);
+    }
+    s[len] = '\0';
+    *weight = chars + hangul;
+    return len;
+}
+
+static char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* data = n >= 0 ? malloc(n + 1) : NULL;
+    if (data && fread(data, 1, n, fp) != (size_t)n) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    if (data) {
+        data[n] = '\0';
+        *size = n;
+    }
+    return data;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "사용법: %s <단어목록.txt> <풀파일>\n", argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char* data = read_file(argv[1], &size);
+    if (data == NULL) {
+        fprintf(stderr, "'%s'를 읽을 수 없습니다. (%s)\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    size_t lines = 1;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') lines++;
+    }
+    struct word* words = malloc(sizeof(*words) * lines);
+    if (words == NULL) {
+        fprintf(stderr, "메모리 부족\n");
+        return 1;
+    }
+
+    size_t n = 0;
+    for (char* line = strtok(data, "\n"); line; line = strtok(NULL, "\n")) {
+        uint32_t weight;
+        size_t len = clean_word(line, &weight);
+        if (len == 0) continue;
+        words[n].text = line;
+        words[n].len = len;
+        words[n].weight = weight;
+        words[n].sig = wp_letter_sig(line, len);
+        n++;
+    }
+
+    // 중복 제거
+    qsort(words, n, sizeof(*words), cmp_text);
+    size_t uniq = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (uniq > 0 && strcmp(words[uniq - 1].text, words[i].text) == 0) continue;
+        words[uniq++] = words[i];
+    }
+    n = uniq;
+
+    // 서명이 같은 묶음마다 글자 구성을 다시 확인하지 않고 개수만 센다.
+    // 서명 충돌은 server가 정답을 확인할 때 걸러낸다.
+    qsort(words, n, sizeof(*words), cmp_sig);
+    for (size_t i = 0; i < n; ) {
+        size_t j = i;
+        while (j < n && words[j].sig == words[i].sig) j++;
+        size_t others = j - i - 1;
+        for (size_t k = i; k < j; k++) {
+            words[k].anagrams = others > UINT16_MAX ? UINT16_MAX : others;
+            words[k].tier = word_tier(&words[k]);
+        }
+        i = j;
+    }
+    qsort(words, n, sizeof(*words), cmp_tier);
+
+    struct wordpool_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, WORDPOOL_MAGIC, sizeof(hdr.magic));
+    hdr.version = WORDPOOL_VERSION;
+    hdr.word_count = n;
+    hdr.entries_off = sizeof(hdr);
+    hdr.text_off = hdr.entries_off + sizeof(struct wordpool_entry) * n;
+    size_t t = 0;
+    for (int tier = 0; tier <= WP_TIERS; tier++) {
+        while (t < n && words[t].tier < tier) t++;
+        hdr.tier_start[tier] = t;
+    }
+    hdr.tier_start[WP_TIERS] = n;
+
+    FILE* out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        fprintf(stderr, "'%s'를 만들 수 없습니다. (%s)\n", argv[2], strerror(errno));
+        return 1;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    uint64_t text_off = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct wordpool_entry e;
+        memset(&e, 0, sizeof(e));
+        e.sig = words[i].sig;
+        e.text_off = text_off;
+        e.len = words[i].len;
+        e.tier = words[i].tier;
+        e.anagrams = words[i].anagrams;
+        fwrite(&e, sizeof(e), 1, out);
+        text_off += words[i].len + 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        fwrite(words[i].text, words[i].len + 1, 1, out);
+    }
+    hdr.text_size = text_off;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    if (fclose(out) != 0) {
+        perror("풀 파일 쓰기 실패");
+        return 1;
+    }
+
+    printf("단어 %zu개 → %s (쉬움 %u / 보통 %u / 어려움 %u)\n", n, argv[2],
+        hdr.tier_start[1] - hdr.tier_start[0], hdr.tier_start[2] - hdr.tier_start[1],
+        hdr.tier_start[3] - hdr.tier_start[2]);
+    free(words);
+    free(data);
+    return 0;
+}
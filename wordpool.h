@@ -0,0 +1,57 @@
+// 자동 출제용 단어 풀 파일 형식
+// wordpool 도구가 단어 목록을 미리 가공해 만들고, server가 시작할 때 mmap 한다.
+// 값은 모두 리틀 엔디언이며 (라즈베리파이 aarch64 / x86) 그대로 읽는다.
+
+#ifndef WORDPOOL_H
+#define WORDPOOL_H
+
+#include <stdint.h>
+#include "utf8.h"
+
+#define WORDPOOL_MAGIC "ANAGPOOL"
+#define WORDPOOL_VERSION 1
+#define WP_TIERS 3              // 난이도: 쉬움, 보통, 어려움
+
+// 파일 맨 앞
+struct wordpool_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t word_count;
+    uint32_t tier_start[WP_TIERS + 1];  // 난이도 t의 항목은 [tier_start[t], tier_start[t + 1])
+    uint64_t entries_off;               // 항목 배열의 파일 내 위치
+    uint64_t text_off;                  // 단어 문자열 영역의 파일 내 위치
+    uint64_t text_size;
+};
+
+// 단어 하나. 파일 안에서는 난이도 순으로 놓인다.
+struct wordpool_entry {
+    uint64_t sig;           // 글자 구성 서명 (wp_letter_sig)
+    uint32_t text_off;      // 문자열 영역 내 위치 ('\0'으로 끝남)
+    uint8_t len;
+    uint8_t tier;
+    uint16_t anagrams;      // 같은 글자 구성을 가진 다른 단어 수
+};
+
+_Static_assert(sizeof(struct wordpool_header) == 56, "wordpool_header 크기");
+_Static_assert(sizeof(struct wordpool_entry) == 16, "wordpool_entry 크기");
+
+// 글자 하나를 섞는 값 (splitmix64). 서명은 이 값을 글자(코드 포인트)마다
+// 더한 것이라 글자 순서와 무관하다. server의 사전 색인도 같은 계산을 쓴다.
+// 영문만 있는 단어는 바이트와 코드 포인트가 같아 예전 풀 파일도 그대로 맞는다.
+static inline uint64_t wp_mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t wp_letter_sig(const char* w, size_t len) {
+    const char* end = w + len;
+    uint64_t sig = 0;
+    while (w < end) {
+        sig += wp_mix64(utf8_next(&w, end));
+    }
+    return sig;
+}
+
+#endif